@@ -0,0 +1,124 @@
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Folder archive container shared by the LZW and Huffman codecs.
+ *
+ * An archive holds the compressed images of its files back to back, followed by a central directory and a
+ * footer:
+ *
+ *     [entry data...] [file count] [path length, path, codec, offset, size, original size]... [directory offset] [magic]
+ *
+ * The codec is one byte and the magic is the eight bytes "CODEARC1"; all other integers are native size_t
+ * values. The directory is written after the data, so entries can be streamed into the archive as they are
+ * compressed, and read first on extraction, so any entry can be located without touching the others.
+ */
+namespace archive
+{
+    /**
+     * @brief Codec that produced an entry's data.
+     */
+    enum class Codec : uint8_t
+    {
+        Lzw = 1,
+        Huffman = 2,
+    };
+
+    /**
+     * @brief Name of a codec as used on the command line ("lzw" or "huffman").
+     */
+    const char *codecName(Codec codec);
+
+    /**
+     * @brief Central directory record of one compressed file.
+     */
+    struct Entry
+    {
+        std::string path;    ///< Path relative to the archived folder, with '/' separators.
+        Codec codec;         ///< Codec of the compressed data.
+        size_t offset;       ///< Offset of the compressed data from the start of the archive.
+        size_t size;         ///< Size of the compressed data in bytes.
+        size_t originalSize; ///< Size of the file before compression.
+    };
+
+    /**
+     * @brief Compresses one file: reads the original from the given path, writes the image to the stream.
+     */
+    using Encoder = std::function<void(const std::string &, std::ostream &)>;
+
+    /**
+     * @brief Decompresses one entry; the third argument identifies the calling worker (below the resolved thread count).
+     */
+    using Decoder = std::function<void(std::istream &, std::ostream &, unsigned)>;
+
+    /**
+     * @brief Read the central directory of an archive.
+     * @param in Archive stream; its position is left unspecified.
+     * @return Entries in archive order.
+     * @throws std::runtime_error If the directory is malformed, points outside the data or holds an unsafe path.
+     */
+    std::vector<Entry> readIndex(std::istream &in);
+
+    /**
+     * @brief Read the central directory of the archive at inputFile.
+     * @throws std::runtime_error If the file cannot be opened or is not a valid archive.
+     */
+    std::vector<Entry> list(const std::string &inputFile);
+
+    /**
+     * @brief Archive every regular file below inputFolder, compressing files on a worker pool.
+     *
+     * Files are stored in sorted path order and written by the calling thread, so the archive is byte-identical
+     * for any thread count.
+     *
+     * @param inputFolder Folder to archive.
+     * @param outputFile Path of the archive to create.
+     * @param codec Codec recorded for every entry.
+     * @param threads Worker threads (0 uses every hardware thread).
+     * @param encode Codec entry point, called concurrently from worker threads.
+     * @throws std::runtime_error If a file cannot be read or the archive cannot be written.
+     */
+    void create(const std::string &inputFolder, const std::string &outputFile, Codec codec, unsigned threads, const Encoder &encode);
+
+    /**
+     * @brief Extract every entry of an archive into a fresh outputFolder, decoding entries on a worker pool.
+     *
+     * Directories are created up front; each worker then reads its entry's byte range with pread and writes
+     * its own output file.
+     *
+     * @param inputFile Path of the archive.
+     * @param outputFolder Folder to create (removed first if it exists).
+     * @param codec Codec of decode; entries written by another codec are rejected.
+     * @param threads Worker threads (0 uses every hardware thread).
+     * @param decode Codec entry point, called concurrently from worker threads.
+     * @throws std::runtime_error If the archive is malformed or a file cannot be written.
+     */
+    void extract(const std::string &inputFile, const std::string &outputFolder, Codec codec, unsigned threads, const Decoder &decode);
+
+    /**
+     * @brief Decode a single entry to outputFile, reading only that entry's bytes.
+     *
+     * @param inputFile Path of the archive.
+     * @param entry Directory record of the entry, as returned by list().
+     * @param outputFile Path of the file to write.
+     * @param decode Entry point of the entry's codec; called once as worker 0.
+     * @throws std::runtime_error If the entry is malformed or the file cannot be written.
+     */
+    void extractEntry(const std::string &inputFile, const Entry &entry, const std::string &outputFile, const Decoder &decode);
+
+    /**
+     * @brief Decode a single entry to output, e.g. standard output, reading only that entry's bytes.
+     *
+     * @throws std::runtime_error If the entry is malformed.
+     */
+    void extractEntry(const std::string &inputFile, const Entry &entry, std::ostream &output, const Decoder &decode);
+}
+
+#endif // ARCHIVE_HPP
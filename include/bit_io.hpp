@@ -0,0 +1,218 @@
+#ifndef BIT_IO_HPP
+#define BIT_IO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace io
+{
+    /**
+     * @brief Bytes moved per read or write call by the stream-backed readers and writers.
+     */
+    constexpr size_t BUFFER_SIZE = size_t{1} << 18;
+
+    /**
+     * @brief Load 8 bytes as a big-endian word (compilers fold this into a single bswap).
+     */
+    inline uint64_t loadBigEndian64(const uint8_t *p)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    /**
+     * @brief MSB-first bit reader over a byte buffer; bits past the end read as zero.
+     */
+    struct BitReader
+    {
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        size_t pos = 0;
+        uint64_t buffer = 0; // Pending bits, left aligned
+        unsigned available = 0;
+
+        BitReader() = default;
+
+        BitReader(const uint8_t *bytes, size_t byteCount) : data(bytes), size(byteCount) {}
+
+        /**
+         * @brief Make sure at least 57 bits are buffered.
+         */
+        inline void refill()
+        {
+            if (pos + 8 <= size)
+            {
+                buffer |= loadBigEndian64(data + pos) >> available;
+                const unsigned bytes = (64 - available) >> 3;
+                pos += bytes;
+                available += bytes * 8;
+                return;
+            }
+            while (available <= 56)
+            {
+                const uint64_t byte = pos < size ? data[pos] : 0;
+                ++pos;
+                buffer |= byte << (56 - available);
+                available += 8;
+            }
+        }
+
+        inline uint32_t peek(unsigned count) const { return static_cast<uint32_t>(buffer >> (64 - count)); }
+
+        inline uint64_t peek64(unsigned count) const { return buffer >> (64 - count); }
+
+        inline void consume(unsigned count)
+        {
+            buffer <<= count;
+            available -= count;
+        }
+    };
+
+    /**
+     * @brief MSB-first bit writer flushing 32 bits at a time into a preallocated buffer.
+     *
+     * Each put() may store 4 bytes at out, so the buffer needs 4 bytes of slack past the last whole byte.
+     */
+    struct BitWriter
+    {
+        uint8_t *out;
+        uint64_t accumulator = 0; // Pending bits, right aligned
+        unsigned pending = 0;     // Always < 32 between calls
+
+        explicit BitWriter(uint8_t *buffer) : out(buffer) {}
+
+        inline void put(uint64_t code, unsigned length)
+        {
+            if (length > 32)
+            {
+                put(code >> 32, length - 32);
+                length = 32;
+                code &= 0xFFFFFFFFu;
+            }
+            accumulator = (accumulator << length) | code;
+            pending += length;
+            if (pending >= 32)
+            {
+                pending -= 32;
+                const uint32_t word = static_cast<uint32_t>(accumulator >> pending);
+                out[0] = static_cast<uint8_t>(word >> 24);
+                out[1] = static_cast<uint8_t>(word >> 16);
+                out[2] = static_cast<uint8_t>(word >> 8);
+                out[3] = static_cast<uint8_t>(word);
+                out += 4;
+            }
+        }
+
+        /**
+         * @brief Write the remaining bits, zero padded to a whole byte.
+         */
+        inline void flush()
+        {
+            while (pending >= 8)
+            {
+                pending -= 8;
+                *out++ = static_cast<uint8_t>(accumulator >> pending);
+            }
+            if (pending > 0)
+            {
+                *out++ = static_cast<uint8_t>(accumulator << (8 - pending));
+                pending = 0;
+            }
+        }
+    };
+
+    /**
+     * @brief BitWriter into a stream: codes collect in a BUFFER_SIZE buffer that is written with one call when full.
+     */
+    class StreamBitWriter
+    {
+    public:
+        explicit StreamBitWriter(std::ostream &output);
+
+        StreamBitWriter(const StreamBitWriter &) = delete;
+        StreamBitWriter &operator=(const StreamBitWriter &) = delete;
+
+        inline void put(uint32_t code, unsigned width)
+        {
+            writer.put(code, width);
+            if (writer.out >= limit)
+            {
+                drain();
+            }
+        }
+
+        /**
+         * @brief Write the remaining bits, zero padded to a whole byte, and hand everything to the stream.
+         */
+        void flush();
+
+        /**
+         * @brief Drop any pending bits and write to output from now on, keeping the buffer.
+         */
+        void reset(std::ostream &output);
+
+    private:
+        std::ostream *out;
+        std::vector<uint8_t> buffer;
+        uint8_t *limit;
+        BitWriter writer;
+
+        void drain();
+    };
+
+    /**
+     * @brief Reads MSB-first codes of up to 32 bits from a stream, BUFFER_SIZE bytes per read call.
+     *
+     * The bytes are read into storage, grown to BUFFER_SIZE on first use, so a caller decoding many streams
+     * can keep one buffer for all of them. Reading ahead leaves the stream past the last code until
+     * returnUnread() is called.
+     */
+    class StreamBitReader
+    {
+    public:
+        StreamBitReader(std::istream &input, std::vector<uint8_t> &storage);
+
+        StreamBitReader(const StreamBitReader &) = delete;
+        StreamBitReader &operator=(const StreamBitReader &) = delete;
+
+        /**
+         * @brief Read the next width bits.
+         * @throws std::runtime_error If the stream ends first.
+         */
+        inline uint32_t get(unsigned width)
+        {
+            if (available < width)
+            {
+                refill(width);
+            }
+            available -= width;
+            return static_cast<uint32_t>(accumulator >> available) & static_cast<uint32_t>((uint64_t{1} << width) - 1);
+        }
+
+        /**
+         * @brief Seek the stream back to the byte after the last code read, dropping its padding bits.
+         *
+         * @return False if the stream cannot seek; it then stays positioned after the read-ahead bytes.
+         */
+        bool returnUnread();
+
+    private:
+        std::istream &in;
+        std::vector<uint8_t> &buffer;
+        size_t size = 0;
+        size_t pos = 0;
+        uint64_t accumulator = 0; // Pending bits, right aligned
+        unsigned available = 0;
+
+        void refill(unsigned width);
+    };
+}
+
+#endif // BIT_IO_HPP
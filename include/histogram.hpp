@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace histogram
+{
+    /**
+     * @brief Number of distinct byte values.
+     */
+    constexpr size_t BYTE_VALUES = 256;
+
+    /**
+     * @brief Occurrences of every byte value.
+     */
+    using Histogram = std::array<uint64_t, BYTE_VALUES>;
+
+    /**
+     * @brief Count the byte values of a buffer.
+     *
+     * Reads the input 16 bytes at a time (two 64-bit loads) and spreads consecutive bytes over four
+     * interleaved 32-bit counter tables, so runs of the same byte do not serialize on a single counter's
+     * store-to-load dependency. The tables are merged into the result at the end (and every 1 GiB, before
+     * the 32-bit counters could overflow).
+     *
+     * @param data Pointer to the input bytes.
+     * @param size Number of input bytes.
+     * @param counts Histogram to add the counts to.
+     */
+    void count(const uint8_t *data, size_t size, Histogram &counts);
+
+    /**
+     * @brief Shannon entropy of a histogram.
+     * @param counts Byte counts.
+     * @return Entropy in bits per byte (0 for an empty histogram).
+     */
+    double entropy(const Histogram &counts);
+}
+
+#endif // HISTOGRAM_HPP
@@ -2,87 +2,516 @@
 #define HUFFMAN_TREE_HPP
 
 #include <iostream>
-#include <unordered_map>
+#include <cstdint>
+#include <array>
 #include <vector>
 #include <string>
-#include <queue>
-#include <bitset>
+#include <span>
+#include <cstddef>
 #include <fstream>
 #include <filesystem>
+#include "histogram.hpp"
 
 namespace fs = std::filesystem;
 namespace huffman
 {
     /**
-     * @brief A node in the Huffman tree.
+     * @brief Number of distinct byte symbols.
      */
-    struct Node
+    constexpr size_t SYMBOL_COUNT = 256;
+
+    /**
+     * @brief Longest code length the 64-bit bit reader can resolve in one peek.
+     */
+    constexpr unsigned MAX_CODE_LENGTH = 57;
+
+    /**
+     * @brief Default code length cap; codes of at most this length decode with one table lookup plus one range check.
+     */
+    constexpr unsigned DEFAULT_MAX_CODE_LENGTH = 12;
+
+    /**
+     * @brief Shortest usable code length cap (256 symbols need 8 bits).
+     */
+    constexpr unsigned MIN_CODE_LENGTH_LIMIT = 8;
+
+    /**
+     * @brief Code length of every byte value (0 for bytes that do not occur).
+     */
+    using CodeLengths = std::array<uint8_t, SYMBOL_COUNT>;
+
+    /**
+     * @brief Canonical Huffman codes derived from a set of code lengths.
+     */
+    struct CodeTable
+    {
+        std::array<uint64_t, SYMBOL_COUNT> codes{}; ///< Code of each byte value, right aligned.
+        CodeLengths lengths{};                      ///< Length of each code in bits.
+    };
+
+    /**
+     * @brief Byte frequency histogram.
+     */
+    using Histogram = histogram::Histogram;
+
+    /**
+     * @brief Reusable scratch space for building Huffman code lengths.
+     *
+     * Counts bytes into a flat 256-bucket histogram and builds the tree with the two-queue method over
+     * fixed node arrays: leaves sorted by frequency form the first queue, merged nodes are produced in
+     * non-decreasing order and form the second. Depths are resolved by one backward pass over the
+     * parent links. Nothing is allocated and nothing recurses, so one builder per thread can be reused
+     * for every call.
+     */
+    class TreeBuilder
     {
-        int frequency;  ///< Frequency of the character.
-        char character; ///< Character associated with the node ('\0' for internal nodes).
-        Node *left;     ///< Pointer to the left child node.
-        Node *right;    ///< Pointer to the right child node.
+    public:
+        /**
+         * @brief Count the bytes of a buffer and build its code lengths.
+         * @param data Pointer to the input bytes.
+         * @param size Number of input bytes.
+         * @return Code lengths indexed by byte value (unbounded depth). A lone symbol gets length 1.
+         */
+        CodeLengths build(const uint8_t *data, size_t size);
 
         /**
-         * @brief Constructor for Node.
-         * @param ch The character.
-         * @param freq The frequency of the character.
+         * @brief Build code lengths from a byte histogram.
+         * @param frequency Occurrences of each byte value.
+         * @return Code lengths indexed by byte value (unbounded depth). A lone symbol gets length 1.
          */
-        Node(char ch, int freq);
+        CodeLengths build(const Histogram &frequency);
+
+    private:
+        static constexpr size_t NODE_COUNT = 2 * SYMBOL_COUNT - 1;
+
+        Histogram counts{};                          // Byte counts of the current input.
+        std::array<uint64_t, NODE_COUNT> weight{};   // Leaves (sorted) first, then merged nodes.
+        std::array<uint16_t, NODE_COUNT> parent{};   // Parent index of every node but the root.
+        std::array<uint16_t, NODE_COUNT> depth{};    // Depth of every node.
+        std::array<uint8_t, SYMBOL_COUNT> leafSymbol{}; // Byte value of each sorted leaf.
+    };
+
+    /**
+     * @brief Limit code lengths to a maximum while keeping the code complete.
+     *
+     * Rebalances the per-length code counts (JPEG Annex K.3 style): every code over the cap is paired
+     * with a sibling and moved under a shorter leaf. Lengths are then reassigned so that symbols which
+     * had shorter codes keep codes no longer than those of symbols which had longer ones.
+     *
+     * @param lengths Code lengths indexed by byte value; updated in place.
+     * @param maxLength Longest allowed code, between MIN_CODE_LENGTH_LIMIT and MAX_CODE_LENGTH.
+     *
+     * @throws std::invalid_argument If maxLength is out of range.
+     */
+    void limitCodeLengths(CodeLengths &lengths, unsigned maxLength);
+
+    /**
+     * @brief Assign canonical codes to a set of code lengths.
+     *
+     * Codes are assigned in order of increasing length, ties broken by byte value, so the
+     * encoder and decoder derive identical codes from the lengths alone.
+     *
+     * @param lengths Code lengths indexed by byte value.
+     * @return The canonical code table.
+     */
+    CodeTable canonicalCodes(const CodeLengths &lengths);
+
+    /**
+     * @brief Write code lengths as (length, run - 1) byte pairs covering all 256 symbols.
+     * @param out Output stream.
+     * @param lengths Code lengths indexed by byte value.
+     */
+    void writeCodeLengths(std::ostream &out, const CodeLengths &lengths);
+
+    /**
+     * @brief Read code lengths written by writeCodeLengths.
+     * @param in Input stream.
+     * @return Code lengths indexed by byte value.
+     *
+     * @throws std::runtime_error If the table is truncated or malformed.
+     */
+    CodeLengths readCodeLengths(std::istream &in);
+
+    /**
+     * @brief Encode bytes into a packed bitstream (MSB first).
+     *
+     * Codes are appended through a 64-bit accumulator into an output buffer sized exactly
+     * from the code lengths, so no per-bit intermediate is ever materialized.
+     *
+     * @param data Pointer to the bytes to encode.
+     * @param size Number of bytes to encode.
+     * @param codeTable Canonical codes for every byte that occurs in the input.
+     * @param packed Output buffer; replaced with the packed bits, zero padded to a whole byte.
+     * @return Number of valid bits in packed.
+     */
+    size_t encode(const uint8_t *data, size_t size, const CodeTable &codeTable, std::vector<uint8_t> &packed);
+
+    /**
+     * @brief Number of bits resolved by a single decode table lookup.
+     */
+    constexpr unsigned DECODE_TABLE_BITS = 11;
+
+    /**
+     * @brief Maximum number of symbols emitted by a single decode table lookup.
+     */
+    constexpr unsigned DECODE_MAX_SYMBOLS = 3;
+
+    /**
+     * @brief An entry in the Huffman decode lookup table.
+     *
+     * Indexed by the next DECODE_TABLE_BITS bits of the stream. Entries whose first code is longer
+     * than the table width have count == 0 and are resolved through the canonical length tables.
+     */
+    struct DecodeEntry
+    {
+        uint8_t symbols[DECODE_MAX_SYMBOLS]; ///< Symbols fully decoded within the lookup window.
+        uint8_t count;                       ///< Number of decoded symbols (0 for long codes).
+        uint8_t bits;                        ///< Bits consumed by all decoded symbols.
+        uint8_t firstBits;                   ///< Bits consumed by the first symbol only.
     };
 
     /**
-     * @brief Comparator for the priority queue used in building the Huffman tree.
+     * @brief Lookup tables used by the table-driven Huffman decoder.
      */
-    struct compare
+    struct DecodeTable
     {
-        /**
-         * @brief Compare two nodes by their frequency.
-         * @param left Pointer to the left node.
-         * @param right Pointer to the right node.
-         * @return True if left's frequency is greater than right's.
-         */
-        bool operator()(Node *left, Node *right);
+        std::vector<DecodeEntry> entries;                         ///< 2^DECODE_TABLE_BITS lookup entries.
+        std::array<uint64_t, MAX_CODE_LENGTH + 1> firstCode{};    ///< First canonical code of each length.
+        std::array<uint16_t, MAX_CODE_LENGTH + 1> firstIndex{};   ///< Index of that code in sortedSymbols.
+        std::array<uint16_t, MAX_CODE_LENGTH + 1> lengthCount{};  ///< Number of codes of each length.
+        std::array<uint8_t, SYMBOL_COUNT> sortedSymbols{};        ///< Symbols in canonical order.
+        unsigned maxLength = 0;                                   ///< Longest code length in use.
+    };
+
+    /**
+     * @brief Build the decode lookup tables directly from canonical code lengths.
+     * @param lengths Code lengths indexed by byte value.
+     * @return The decode tables.
+     *
+     * @throws std::runtime_error If the lengths do not describe a valid prefix code.
+     */
+    DecodeTable buildDecodeTable(const CodeLengths &lengths);
+
+    /**
+     * @brief Rebuild decode lookup tables in place, reusing the storage of table.
+     *
+     * @throws std::runtime_error If the lengths do not describe a valid prefix code.
+     */
+    void buildDecodeTable(const CodeLengths &lengths, DecodeTable &table);
+
+    /**
+     * @brief Decode a packed Huffman bitstream (MSB first).
+     * @param table Decode tables built by buildDecodeTable.
+     * @param data Pointer to the packed bits.
+     * @param bitCount Number of valid bits in the stream.
+     * @param out Output buffer of symbolCount bytes.
+     * @param symbolCount Number of symbols the stream is expected to contain.
+     *
+     * @throws std::runtime_error If the stream contains an invalid code or the wrong number of symbols.
+     */
+    void decodeBits(const DecodeTable &table, const uint8_t *data, size_t bitCount, char *out, size_t symbolCount);
+
+    /**
+     * @brief Number of bitstreams in the interleaved layout.
+     */
+    constexpr size_t STREAM_COUNT = 4;
+
+    /**
+     * @brief Size of one segment when a buffer is split into STREAM_COUNT contiguous segments.
+     * @param total Size of the whole buffer.
+     * @param index Segment index.
+     * @return Size of that segment; all but the last are (total + 3) / 4 bytes.
+     */
+    size_t segmentSize(size_t total, size_t index);
+
+    /**
+     * @brief Decode STREAM_COUNT independent bitstreams into consecutive output segments.
+     *
+     * The streams are advanced round-robin, one table lookup each per iteration, so four independent
+     * decode chains are in flight at once instead of one serially dependent chain.
+     *
+     * @param table Decode tables shared by all streams.
+     * @param data Pointer to the packed bits of each stream.
+     * @param bitCounts Number of valid bits in each stream.
+     * @param out Output buffer; stream i fills segmentSize(symbolCount, i) bytes after the previous streams.
+     * @param symbolCount Total number of symbols across all streams.
+     *
+     * @throws std::runtime_error If a stream contains an invalid code or the wrong number of symbols.
+     */
+    void decodeStreams(const DecodeTable &table, const std::array<const uint8_t *, STREAM_COUNT> &data,
+                       const std::array<size_t, STREAM_COUNT> &bitCounts, char *out, size_t symbolCount);
+
+    /**
+     * @brief Layout of the compressed payload, stored in the low bits of the first byte of a compressed file.
+     *
+     * A compressed file is that byte followed by one block (original size, code lengths, bit counts,
+     * packed streams). In block mode the byte has its high bit set and is followed by any number of
+     * blocks, each with its own code table, terminated by an original size of 0. Images coded with a
+     * TrainedTable have bit 6 set, the table id after the byte, and no code lengths in their blocks.
+     */
+    enum class Layout : uint8_t
+    {
+        SingleStream = 0, ///< One bitstream: bit count, then packed bits.
+        FourStreams = 1,  ///< STREAM_COUNT bit counts (jump table), then the packed streams back to back.
+    };
+
+    /**
+     * @brief Smallest block size accepted in block mode.
+     */
+    constexpr size_t MIN_BLOCK_SIZE = size_t{1} << 10;
+
+    /**
+     * @brief Largest block size accepted in block mode.
+     */
+    constexpr size_t MAX_BLOCK_SIZE = size_t{1} << 30;
+
+    /**
+     * @brief A code table trained on sample data and shared by compressor and decompressor.
+     *
+     * Images coded with a trained table store its id instead of a code length table in every block, which
+     * makes Huffman worthwhile for small messages whose own table would cost more than it saves.
+     */
+    struct TrainedTable
+    {
+        uint32_t id = 0;       ///< Identifies the table in compressed images (a hash of the lengths).
+        CodeLengths lengths{}; ///< Code lengths of all 256 byte values.
     };
 
     /**
-     * @brief Build the Huffman tree for a given string.
-     * @param text The input string.
-     * @return Pointer to the root of the Huffman tree.
+     * @brief Build a trained table from byte counts.
+     *
+     * Every byte value gets a code, so any input can be coded with the table; bytes absent from the
+     * samples get the longest codes.
+     *
+     * @throws std::invalid_argument If maxCodeLength is out of range.
      */
-    Node *buildHuffmanTree(const std::string &text);
+    TrainedTable trainTable(const Histogram &frequency, unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
 
     /**
-     * @brief Delete the Huffman tree.
-     * @param root Pointer to the root of the Huffman tree.
+     * @brief Build a trained table from a sample file, or from every file under a sample folder.
+     *
+     * @throws std::runtime_error If a sample cannot be read.
+     * @throws std::invalid_argument If maxCodeLength is out of range.
      */
-    void deleteHuffmanTree(Node *root);
+    TrainedTable trainTable(const std::string &samplePath, unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
 
     /**
-     * @brief Generate Huffman codes for each character.
-     * @param root Pointer to the root of the Huffman tree.
-     * @param str Current Huffman code string.
-     * @param Huffman_tree Map to store the Huffman codes.
+     * @brief Write a trained table to a file: magic, id, then the code lengths as written by writeCodeLengths.
+     *
+     * @throws std::runtime_error If the file cannot be written.
      */
-    void print_code(Node *root, const std::string &str, std::unordered_map<char, std::string> &Huffman_tree);
+    void saveTable(const TrainedTable &table, const std::string &path);
 
     /**
-     * @brief Encode a string using Huffman codes.
-     * @param str The input string to encode.
-     * @param Huffman_tree Map of Huffman codes for characters.
-     * @return Encoded string in binary form.
+     * @brief Read a trained table written by saveTable.
+     *
+     * @throws std::runtime_error If the file cannot be read or does not hold a valid table.
      */
-    std::string encode(const std::string &str, const std::unordered_map<char, std::string> &Huffman_tree);
+    TrainedTable loadTable(const std::string &path);
+
+    /**
+     * @brief Options controlling Huffman compression.
+     */
+    struct CompressOptions
+    {
+        unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH; ///< Longest Huffman code the compressor may emit.
+        Layout layout = Layout::SingleStream;             ///< Payload layout of every block.
+        size_t blockSize = 0;                             ///< Bytes per block (0 codes the whole file as one block).
+        unsigned threads = 1;                             ///< Worker threads for blocks or folder entries (0 uses every hardware thread).
+        const TrainedTable *table = nullptr;              ///< Shared table used instead of per-block tables; must outlive the call.
+    };
 
     /**
      * @brief Compresses a file using the Huffman algorithm.
      *
      * Reads the input file, applies the Huffman compression algorithm, and writes the compressed data to the output file.
+     * With a non-zero options.blockSize the file is read, coded and written one block at a time, so memory use is
+     * bounded by the block size rather than the file size.
      *
      * @param inputFile Path to the input file to be compressed.
      * @param outputFile Path to the output file where compressed data will be written.
+     * @param options Compression options.
+     */
+    void compress(const std::string &inputFile, const std::string &outputFile, const CompressOptions &options = {});
+
+    /**
+     * @brief Compresses everything readable from in and writes one compressed file image to out.
+     *
+     * In block mode the blocks are coded independently on options.threads workers; the output does not depend
+     * on the thread count.
+     *
+     * @param in Stream holding the data to compress.
+     * @param out Stream receiving the layout byte and the block(s).
+     * @param options Compression options.
+     *
+     * @throws std::invalid_argument If options.blockSize is out of range.
+     */
+    void compressStream(std::istream &in, std::ostream &out, const CompressOptions &options = {});
+
+    /**
+     * @brief Compresses size bytes at data and writes one compressed file image to out.
+     *
+     * Produces the same output as compressStream on the same bytes, but codes blocks straight from the buffer
+     * instead of copying them out of a stream.
+     *
+     * @throws std::invalid_argument If options.blockSize is out of range.
+     */
+    void compressBytes(const uint8_t *data, size_t size, std::ostream &out, const CompressOptions &options = {});
+
+    /**
+     * @brief Upper bound on the compressed size of size input bytes, for sizing the output of compressBuffer.
+     *
+     * @throws std::invalid_argument If options.blockSize is out of range.
+     */
+    size_t maxCompressedSize(size_t size, const CompressOptions &options = {});
+
+    /**
+     * @brief Compresses input into a new buffer; the result is the same image compress() writes to a file.
+     *
+     * @throws std::invalid_argument If options.blockSize is out of range.
+     */
+    std::vector<std::byte> compressBuffer(std::span<const std::byte> input, const CompressOptions &options = {});
+
+    /**
+     * @brief Compresses input into a caller-provided buffer.
+     *
+     * @return Number of bytes written to output.
+     *
+     * @throws std::invalid_argument If options.blockSize is out of range or the image does not fit in output;
+     * an output of maxCompressedSize(input.size(), options) bytes always suffices.
+     */
+    size_t compressBuffer(std::span<const std::byte> input, std::span<std::byte> output, const CompressOptions &options = {});
+
+    /**
+     * @brief Compresses the file at inputFile into out, reading it through a memory mapping when it is a regular file.
+     *
+     * @throws std::runtime_error If the file cannot be opened.
+     */
+    void compressFile(const std::string &inputFile, std::ostream &out, const CompressOptions &options = {});
+
+    /**
+     * @brief Decompresses one image written by compressStream from in, reading no further than its last block.
+     *
+     * Blocks of a block-mode image are delimited on the calling thread and decoded on threads workers.
+     *
+     * @param in Stream positioned at the layout byte.
+     * @param out Stream receiving the decompressed data.
+     * @param threads Worker threads for block-mode images (0 uses every hardware thread).
+     * @param table Trained table for images coded with one; ignored otherwise.
+     *
+     * @throws std::runtime_error If the data is malformed or truncated, or needs a trained table other than table.
+     */
+    void decompressStream(std::istream &in, std::ostream &out, unsigned threads = 1, const TrainedTable *table = nullptr);
+
+    /**
+     * @brief Decompresses the image at the start of input into a new buffer.
+     *
+     * @param threads Worker threads for block-mode images (0 uses every hardware thread).
+     * @param table Trained table for images coded with one; ignored otherwise.
+     *
+     * @throws std::runtime_error If the data is malformed or truncated, or needs a trained table other than table.
+     */
+    std::vector<std::byte> decompressBuffer(std::span<const std::byte> input, unsigned threads = 1, const TrainedTable *table = nullptr);
+
+    /**
+     * @brief Decompresses the image at the start of input into a caller-provided buffer.
+     *
+     * @return Number of bytes written to output.
+     *
+     * @throws std::runtime_error If the data is malformed or truncated, or needs a trained table other than table.
+     * @throws std::invalid_argument If the decompressed data does not fit in output.
+     */
+    size_t decompressBuffer(std::span<const std::byte> input, std::span<std::byte> output, unsigned threads = 1,
+                            const TrainedTable *table = nullptr);
+
+    /**
+     * @brief Reusable compression state: the tree builder and the packed-bit buffers.
+     *
+     * Once a context has coded an input, coding the next one allocates nothing but its output. The free
+     * compression functions keep one context per thread; callers coding many small messages can hold their
+     * own. Not thread safe.
+     */
+    class CompressContext
+    {
+    public:
+        /**
+         * @throws std::invalid_argument If options.blockSize is out of range.
+         */
+        explicit CompressContext(const CompressOptions &options = {});
+
+        /**
+         * @brief Compresses input into a new buffer; same image as compressBuffer(input, options), coded on the calling thread.
+         */
+        std::vector<std::byte> compress(std::span<const std::byte> input);
+
+        /**
+         * @brief Compresses input into a caller-provided buffer and returns the number of bytes written.
+         *
+         * @throws std::invalid_argument If the image does not fit in output.
+         */
+        size_t compress(std::span<const std::byte> input, std::span<std::byte> output);
+
+        /**
+         * @brief Encode one block: original size, code lengths, bit count(s), packed stream(s).
+         */
+        void writeBlock(std::ostream &out, const uint8_t *data, size_t size, const CompressOptions &options);
+
+    private:
+        CompressOptions settings;
+        TreeBuilder builder;
+        std::array<std::vector<uint8_t>, STREAM_COUNT> packed; // Packed bits of each stream.
+
+        void compressTo(const uint8_t *data, size_t size, std::ostream &out);
+    };
+
+    /**
+     * @brief Reusable decompression state: the decode table and the packed-bit buffer.
+     *
+     * The decode table is rebuilt in place, and not at all when a block has the same code lengths as the
+     * previous one. The free decompression functions keep one context per thread. Not thread safe.
      */
-    void compress(const std::string &inputFile, const std::string &outputFile);
+    class DecompressContext
+    {
+    public:
+        /**
+         * @param trained Trained table for images coded with one; must outlive the context.
+         */
+        explicit DecompressContext(const TrainedTable *trained = nullptr) : sharedTable(trained) {}
+
+        /**
+         * @brief Decompresses the image at the start of input into a new buffer, on the calling thread.
+         *
+         * @throws std::runtime_error If the data is malformed or truncated.
+         */
+        std::vector<std::byte> decompress(std::span<const std::byte> input);
+
+        /**
+         * @brief Decompresses the image at the start of input into a caller-provided buffer and returns the number of bytes written.
+         *
+         * @throws std::runtime_error If the data is malformed or truncated.
+         * @throws std::invalid_argument If the decompressed data does not fit in output.
+         */
+        size_t decompress(std::span<const std::byte> input, std::span<std::byte> output);
+
+        /**
+         * @brief Decode the rest of a block whose original size has already been read.
+         *
+         * @param shared Trained table of the image, whose blocks then carry no code lengths, or nullptr.
+         *
+         * @throws std::runtime_error If the block is malformed or truncated.
+         */
+        void readBlock(std::istream &in, Layout layout, size_t originalSize, std::string &text, const TrainedTable *shared = nullptr);
+
+    private:
+        const TrainedTable *sharedTable;
+        DecodeTable table;
+        CodeLengths tableLengths{}; // Code lengths table was built from.
+        bool haveTable = false;
+        std::vector<uint8_t> packed; // Packed bits of all streams of the current block.
+        std::string decoded;         // Decoded bytes of the current block.
+
+        void decompressTo(std::istream &in, std::ostream &out);
+    };
 
     /**
      * @brief Decompresses a previously compressed file using the Huffman algorithm.
@@ -91,8 +520,12 @@ namespace huffman
      *
      * @param inputFile Path to the compressed input file.
      * @param outputFile Path to the output file where decompressed data will be written.
+     * @param threads Worker threads decoding blocks concurrently (0 uses every hardware thread).
+     * @param table Trained table for files coded with one; ignored otherwise.
+     *
+     * @throws std::runtime_error If the file is malformed or an error occurs during file operations.
      */
-    void decompress(const std::string &inputFile, const std::string &outputFile);
+    void decompress(const std::string &inputFile, const std::string &outputFile, unsigned threads = 1, const TrainedTable *table = nullptr);
 
     /**
      * @brief Compresses a folder using the Huffman algorithm.
@@ -101,10 +534,11 @@ namespace huffman
      *
      * @param inputFolder Path to the input folder to be compressed.
      * @param outputFile Path to the output file where compressed data will be written.
+     * @param options Compression options applied to every file.
      *
      * @throws std::runtime_error If an error occurs during file operations.
      */
-    void compressFolder(const std::string &folderPath, const std::string &outputFile);
+    void compressFolder(const std::string &folderPath, const std::string &outputFile, const CompressOptions &options = {});
 
     /**
      * @brief Decompresses a previously compressed folder using the Huffman algorithm.
@@ -113,10 +547,13 @@ namespace huffman
      *
      * @param inputFile Path to the compressed input file.
      * @param outputFolder Path to the output folder where decompressed data will be written.
+     * @param threads Worker threads decoding files concurrently (0 uses every hardware thread).
+     * @param table Trained table for archives coded with one; ignored otherwise.
      *
      * @throws std::runtime_error If an error occurs during file operations.
      */
-    void decompressFolder(const std::string &inputFile, const std::string &outputFolder);
+    void decompressFolder(const std::string &inputFile, const std::string &outputFolder, unsigned threads = 1,
+                          const TrainedTable *table = nullptr);
 }
 
 #endif // HUFFMAN_TREE_HPP
\ No newline at end of file
@@ -3,16 +3,36 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <span>
+#include <cstddef>
 #include <cstdint>
 #include <array>
 #include <stdexcept>
 #include <filesystem>
+#include <iosfwd>
+#include <memory>
 
 namespace fs = std::filesystem;
 
 namespace lzw
 {
+    class CompressContext;
+
+    /**
+     * @brief Phrases trained on sample data that seed the dictionary before coding starts.
+     *
+     * Entry i is code LZW::FIRST_CODE + i and stands for the sequence of prefixes[i] followed by bytes[i], where
+     * the prefix is a single byte or an earlier entry. Images coded with a trained dictionary store its id and
+     * start, and restart after every CLEAR, with these phrases already defined, so short inputs match long
+     * phrases from their first bytes.
+     */
+    struct TrainedDictionary
+    {
+        uint32_t id = 0;                // Identifies the dictionary in compressed images (a hash of the entries).
+        std::vector<uint32_t> prefixes; // Code of each entry's sequence without its last byte.
+        std::vector<uint8_t> bytes;     // Last byte of each entry's sequence.
+    };
+
     /**
      * @brief LZW class for compressing and decompressing files using Lempel-Ziv-Welch algorithm.
      *
@@ -23,6 +43,37 @@ namespace lzw
     class LZW
     {
     public:
+        static constexpr unsigned MIN_CODE_BITS = 9;      // Smallest configurable dictionary (2^9 codes).
+        static constexpr unsigned MAX_CODE_BITS = 20;     // Largest configurable dictionary (2^20 codes).
+        static constexpr unsigned DEFAULT_CODE_BITS = 16; // Default dictionary size (2^16 codes).
+        static constexpr size_t MIN_BLOCK_SIZE = 1 << 10; // Smallest block accepted in block mode.
+        static constexpr size_t MAX_BLOCK_SIZE = 1 << 30; // Largest block accepted in block mode.
+        static constexpr uint32_t FIRST_CODE = 258;       // First code assigned to a multi-byte sequence.
+
+        /**
+         * @brief Creates a compressor whose dictionary holds up to 2^maxCodeBits codes.
+         *
+         * Once the dictionary is full the compressor keeps monitoring its compression ratio and emits a CLEAR
+         * code to start over with a fresh dictionary when the ratio drops. The decompressor reads the dictionary
+         * size from the compressed header, so it handles files written with any setting.
+         *
+         * With a non-zero blockSize the input is split into blocks of that many bytes, each coded with a fresh
+         * dictionary, so blocks can be compressed and decompressed on separate threads.
+         *
+         * With a trained dictionary, every dictionary (and every block's) starts out with its phrases, and the
+         * decompressor needs the same one for images coded with it. Compressing throws std::invalid_argument
+         * when the phrases do not fit in 2^maxCodeBits codes; decompressing takes the size from the image.
+         *
+         * @param maxCodeBits Dictionary size in bits, between MIN_CODE_BITS and MAX_CODE_BITS.
+         * @param threads Worker threads for blocks and folder archive entries (0 uses every hardware thread).
+         * @param blockSize Bytes per block, between MIN_BLOCK_SIZE and MAX_BLOCK_SIZE, or 0 for a single stream.
+         * @param dictionary Trained phrases, or nullptr; must outlive the object and not change while it is used.
+         *
+         * @throws std::invalid_argument If maxCodeBits or blockSize is out of range.
+         */
+        explicit LZW(unsigned maxCodeBits = DEFAULT_CODE_BITS, unsigned threads = 1, size_t blockSize = 0,
+                     const TrainedDictionary *dictionary = nullptr);
+
         /**
          * @brief Compresses a file using the LZW algorithm.
          *
@@ -47,6 +98,70 @@ namespace lzw
          */
         void decompress(const std::string &inputFile, const std::string &outputFile);
 
+        /**
+         * @brief Compresses input until end of stream into a dictionary-size byte followed by codes ending in END_CODE.
+         *
+         * Input and output pass through fixed-size buffers, so memory use does not depend on the input size. In
+         * block mode each block is coded independently on the worker threads and stored as a size-prefixed record.
+         */
+        void compressStream(std::istream &input, std::ostream &output) const;
+
+        /**
+         * @brief Compresses size bytes at data; same output as compressStream on the same bytes, without copying them.
+         */
+        void compressBytes(const uint8_t *data, size_t size, std::ostream &output) const;
+
+        /**
+         * @brief Compresses the file at inputFile into output, reading it through a memory mapping when it is a regular file.
+         *
+         * @throws std::runtime_error If the file cannot be opened.
+         */
+        void compressFile(const std::string &inputFile, std::ostream &output) const;
+
+        /**
+         * @brief Upper bound on the compressed size of size input bytes with this compressor's settings.
+         */
+        size_t maxCompressedSize(size_t size) const;
+
+        /**
+         * @brief Compresses input into a new buffer; the result is the same image compress() writes to a file.
+         */
+        std::vector<std::byte> compressBuffer(std::span<const std::byte> input) const;
+
+        /**
+         * @brief Compresses input into a caller-provided buffer and returns the number of bytes written.
+         *
+         * @throws std::invalid_argument If the image does not fit in output; maxCompressedSize(input.size()) bytes always suffice.
+         */
+        size_t compressBuffer(std::span<const std::byte> input, std::span<std::byte> output) const;
+
+        /**
+         * @brief Decompresses one stream written by compressStream, stopping at its END_CODE (or end block).
+         *
+         * The codes are read in large chunks. Afterwards a seekable input (files, memory, string streams) is
+         * moved back to the byte after the image, so images can be stored back to back. An input that cannot
+         * seek (pipes) may be left past the end of the image.
+         *
+         * @throws std::runtime_error If the stream is truncated or holds an invalid code, or was coded with a
+         *         trained dictionary other than this object's.
+         */
+        void decompressStream(std::istream &input, std::ostream &output);
+
+        /**
+         * @brief Decompresses the image at the start of input into a new buffer.
+         *
+         * @throws std::runtime_error If the data is truncated or holds an invalid code.
+         */
+        std::vector<std::byte> decompressBuffer(std::span<const std::byte> input);
+
+        /**
+         * @brief Decompresses the image at the start of input into a caller-provided buffer and returns the number of bytes written.
+         *
+         * @throws std::runtime_error If the data is truncated or holds an invalid code.
+         * @throws std::invalid_argument If the decompressed data does not fit in output.
+         */
+        size_t decompressBuffer(std::span<const std::byte> input, std::span<std::byte> output);
+
         /**
          * @brief Compresses a folder using the LZW algorithm.
          *
@@ -72,26 +187,130 @@ namespace lzw
         void decompressFolder(const std::string &inputFile, const std::string &outputFolder);
 
     private:
-        static constexpr size_t DICTIONARY_SIZE = 4096;  // Maximum size of the dictionary.
         static constexpr size_t INITIAL_DICT_SIZE = 256; // Initial size of the dictionary (first 256 byte entries).
+        static constexpr uint32_t CLEAR_CODE = 256;       // Resets the dictionary to its initial state.
+        static constexpr uint32_t END_CODE = 257;         // Marks the end of the code stream.
+        static constexpr int BLOCKED_FLAG = 0x80;         // Set in the header byte when the data is a sequence of blocks.
+        static constexpr int PRIMED_FLAG = 0x40;          // Set in the header byte when a trained dictionary id follows it.
+
+        unsigned codeBits;                         // Dictionary size in bits used when compressing.
+        unsigned threadCount;                      // Worker threads for blocks and folder archives.
+        size_t blockBytes;                         // Bytes per block when compressing, 0 for a single stream.
+        const TrainedDictionary *trained;          // Phrases seeding every dictionary, or nullptr.
+        const TrainedDictionary *loaded = nullptr; // Trained phrases currently held by the decompression dictionary.
+
+        // Decompression dictionary as flat prefix chains: code c stands for the sequence of
+        // prefixCode[c] followed by lastByte[c]. Codes below INITIAL_DICT_SIZE are single bytes.
+        std::vector<uint32_t> prefixCode; // Code of the sequence without its last byte.
+        std::vector<uint8_t> lastByte;    // Last byte of the sequence.
+        std::vector<uint8_t> firstByte;   // First byte of the sequence.
+        std::vector<uint32_t> length;     // Length of the sequence in bytes.
+
+        std::vector<uint8_t> codeBuffer;   // Compressed bytes read ahead by the decoder.
+        std::vector<uint8_t> outputBuffer; // Decoded bytes waiting to be written.
+
+        /**
+         * @brief Sizes the decompression dictionary for dictionarySize codes and sets the first 256 single-byte
+         * sequences, followed by the primed phrases unless they are still there from the previous stream.
+         */
+        void initializeDictionary(size_t dictionarySize, const TrainedDictionary *primed);
+
+        /**
+         * @brief Writes the header byte (code bits and flags) and the trained dictionary id if there is one.
+         *
+         * @throws std::invalid_argument If the trained phrases do not fit in 2^codeBits codes.
+         */
+        static void writeHeader(std::ostream &output, unsigned codeBits, bool blocked, const TrainedDictionary *dictionary);
+
+        class Encoder; // Incremental code stream writer, defined in lzw.cpp.
+        friend class CompressContext;
+
+        /**
+         * @brief This thread's encoder, reset to write a new code stream to output.
+         *
+         * Built on first use and rebuilt only when codeBits or the trained dictionary change, so coding many
+         * blocks or files does not allocate a phrase table and code buffer for each one.
+         */
+        static Encoder &threadEncoder(unsigned codeBits, const TrainedDictionary *dictionary, std::ostream &output);
+
+        /**
+         * @brief Codes input until end of stream as variable-width codes ending in END_CODE, without a header.
+         */
+        void encodeCodes(std::istream &input, std::ostream &output) const;
+
+        /**
+         * @brief Decodes codes written by encodeCodes for a dictionary of dictionarySize codes, seeded with primed.
+         */
+        void decodeCodes(std::istream &input, std::ostream &output, uint32_t dictionarySize, const TrainedDictionary *primed);
+    };
+
+    /**
+     * @brief Trains a dictionary on a sample file, or on every file under a sample folder.
+     *
+     * Each sample is parsed as LZW would code it while counting how often every phrase is matched; the most
+     * used phrases, up to half of the 2^codeBits codes, become the dictionary.
+     *
+     * @throws std::runtime_error If a sample cannot be read.
+     * @throws std::invalid_argument If codeBits is out of range.
+     */
+    TrainedDictionary trainDictionary(const std::string &samplePath, unsigned codeBits = LZW::DEFAULT_CODE_BITS);
+
+    /**
+     * @brief Writes a trained dictionary to a file: magic, id, entry count, then the entries.
+     *
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void saveDictionary(const TrainedDictionary &dictionary, const std::string &path);
+
+    /**
+     * @brief Reads a trained dictionary written by saveDictionary.
+     *
+     * @throws std::runtime_error If the file cannot be read or does not hold a valid dictionary.
+     */
+    TrainedDictionary loadDictionary(const std::string &path);
 
+    /**
+     * @brief Reusable single-stream compressor for many small inputs.
+     *
+     * The phrase table and code buffer are allocated by the first call and kept; later calls reset the table
+     * by bumping its generation, so their cost depends on the input size rather than on the dictionary size.
+     * Produces the same images as LZW::compressBuffer without block mode. The decompression counterpart is a
+     * reused LZW object, which keeps its dictionary and buffers between decompressBuffer calls.
+     * Not thread safe: use one context per thread.
+     */
+    class CompressContext
+    {
+    public:
         /**
-         * @brief Dictionary entry structure.
+         * @param dictionary Trained phrases, or nullptr; must outlive the context. They are entered into the phrase
+         *        table once and survive the resets between calls.
          *
-         * Holds a sequence of bytes and a flag to track if the entry has been used.
+         * @throws std::invalid_argument If maxCodeBits is out of range or the trained phrases do not fit.
          */
-        struct DictEntry
-        {
-            std::vector<uint8_t> sequence; // Sequence of bytes in the dictionary entry.
-            bool used = false;             // Flag indicating whether the entry has been used.
-        };
+        explicit CompressContext(unsigned maxCodeBits = LZW::DEFAULT_CODE_BITS, const TrainedDictionary *dictionary = nullptr);
+        ~CompressContext();
+
+        CompressContext(const CompressContext &) = delete;
+        CompressContext &operator=(const CompressContext &) = delete;
 
-        std::array<DictEntry, DICTIONARY_SIZE> dictionary; // Fixed-size dictionary for compression and decompression.
+        /**
+         * @brief Compresses input into a new buffer.
+         */
+        std::vector<std::byte> compress(std::span<const std::byte> input);
 
         /**
-         * @brief Initializes the dictionary with the first 256 single-byte sequences.
+         * @brief Compresses input into a caller-provided buffer and returns the number of bytes written.
+         *
+         * @throws std::invalid_argument If the image does not fit in output.
          */
-        void initializeDictionary();
+        size_t compress(std::span<const std::byte> input, std::span<std::byte> output);
+
+    private:
+        unsigned codeBits;
+        const TrainedDictionary *trained;
+        std::unique_ptr<LZW::Encoder> encoder;
+
+        void compressTo(std::span<const std::byte> input, std::ostream &output);
     };
 }; // namespace lzw
 #endif // LZW_H
@@ -0,0 +1,152 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace io
+{
+    /**
+     * @brief Read-only memory mapping of a whole file.
+     *
+     * Regular files are mapped with a sequential-access hint, so the codecs read them straight from the page
+     * cache without copying them into process memory. Files that cannot be mapped (pipes, character devices)
+     * are reported through mapped() so callers can fall back to stream I/O.
+     */
+    class MappedFile
+    {
+    public:
+        /**
+         * @brief Open and map path.
+         * @throws std::runtime_error If the file cannot be opened.
+         */
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /**
+         * @brief True if the file's contents are available through data() and size().
+         */
+        bool mapped() const { return isMapped; }
+
+        const uint8_t *data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        const uint8_t *bytes = nullptr;
+        size_t length = 0;
+        bool isMapped = false;
+    };
+
+    /**
+     * @brief Stream buffer reading from a fixed range of memory, e.g. a MappedFile, without copying it.
+     *
+     * Seekable within the range, so readers that buffer ahead can return what they did not use.
+     */
+    class MemoryBuffer : public std::streambuf
+    {
+    public:
+        MemoryBuffer(const uint8_t *data, size_t size);
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+    };
+
+    /**
+     * @brief Stream buffer writing into a fixed range of memory; a write past its end fails the stream.
+     */
+    class SpanBuffer : public std::streambuf
+    {
+    public:
+        SpanBuffer(uint8_t *data, size_t size);
+
+        /**
+         * @brief Bytes written so far.
+         */
+        size_t written() const { return static_cast<size_t>(pptr() - pbase()); }
+    };
+
+    /**
+     * @brief Stream buffer appending everything written to a byte vector.
+     */
+    class VectorBuffer : public std::streambuf
+    {
+    public:
+        explicit VectorBuffer(std::vector<std::byte> &target) : bytes(target) {}
+
+    protected:
+        std::streamsize xsputn(const char *data, std::streamsize count) override;
+        int_type overflow(int_type c) override;
+
+    private:
+        std::vector<std::byte> &bytes;
+    };
+
+    /**
+     * @brief Input stream over a file: reads from a memory mapping when the file can be mapped and through a
+     * file buffer otherwise (pipes, devices).
+     */
+    class InputFile
+    {
+    public:
+        /**
+         * @brief Open path for reading.
+         * @throws std::runtime_error If the file cannot be opened.
+         */
+        explicit InputFile(const std::string &path);
+
+        InputFile(const InputFile &) = delete;
+        InputFile &operator=(const InputFile &) = delete;
+
+        std::istream &stream() { return in; }
+
+    private:
+        MappedFile mapping;
+        MemoryBuffer memory;
+        std::vector<char> fallbackBuffer;
+        std::filebuf fallback;
+        std::istream in;
+    };
+
+    /**
+     * @brief Output stream over a file with a large write buffer, so the many small header and index writes
+     * of the codecs reach the kernel as a few large writes.
+     */
+    class OutputFile
+    {
+    public:
+        /**
+         * @brief Create or truncate path for writing.
+         * @throws std::runtime_error If the file cannot be opened.
+         */
+        explicit OutputFile(const std::string &path);
+
+        OutputFile(const OutputFile &) = delete;
+        OutputFile &operator=(const OutputFile &) = delete;
+
+        std::ostream &stream() { return out; }
+
+        /**
+         * @brief Write out the buffer and close the file.
+         * @throws std::runtime_error If any write failed.
+         */
+        void close();
+
+    private:
+        std::string name;
+        std::vector<char> buffer;
+        std::filebuf file;
+        std::ostream out;
+    };
+}
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,68 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace parallel
+{
+    /**
+     * @brief Number of worker threads to use for a requested count.
+     * @param requested Requested thread count; 0 means one per hardware thread.
+     * @return The thread count, at least 1.
+     */
+    unsigned resolveThreads(unsigned requested);
+
+    /**
+     * @brief Run a three-stage pipeline over a sequence of items: read in order, transform on a pool of worker
+     * threads, write in order.
+     *
+     * read(i, input) is called for i = 0, 1, ... (never concurrently, always in index order) to fill input with
+     * item i, and returns false once there are no more items. transform(i, worker, input) runs concurrently on
+     * the workers, with worker below resolveThreads(threads), and returns the result that write(i, result)
+     * receives on the calling thread in index order. At most 2 * threads items are in flight. With one thread
+     * everything runs inline on the calling thread. The first exception thrown by any stage stops the pipeline
+     * and is rethrown once all workers have finished.
+     *
+     * @param threads Requested thread count, resolved with resolveThreads().
+     * @param read Produces the next input; may reuse the buffer it is given.
+     * @param transform Computes the result of one item.
+     * @param write Receives the results in order.
+     */
+    void orderedPipeline(unsigned threads, const std::function<bool(size_t, std::string &)> &read,
+                         const std::function<std::string(size_t, unsigned, std::string &)> &transform,
+                         const std::function<void(size_t, std::string &)> &write);
+
+    /**
+     * @brief Run produce(i) for every i below count on a pool of worker threads and hand each result to
+     * consume(i, result) on the calling thread in index order.
+     *
+     * Workers run at most 2 * threads indices ahead of the consumer, which bounds the number of results held
+     * in memory. With one thread (or one item) everything runs inline on the calling thread. The first
+     * exception thrown by produce or consume stops the pool and is rethrown once all workers have finished.
+     *
+     * @param count Number of items.
+     * @param threads Requested thread count, resolved with resolveThreads().
+     * @param produce Computes the result of one item; called concurrently from worker threads.
+     * @param consume Receives the results in order; called from the calling thread only.
+     */
+    void orderedMap(size_t count, unsigned threads, const std::function<std::string(size_t)> &produce,
+                    const std::function<void(size_t, std::string &)> &consume);
+
+    /**
+     * @brief Run task(i, worker) for every i below count on a pool of worker threads, in no particular order.
+     *
+     * Each worker handles one index at a time and passes its own id (below resolveThreads(threads)) as the
+     * second argument, so callers can keep per-worker state. With one thread (or one item) everything runs
+     * inline as worker 0. The first exception thrown by a task stops the pool from starting new indices and
+     * is rethrown once all workers have finished.
+     *
+     * @param count Number of items.
+     * @param threads Requested thread count, resolved with resolveThreads().
+     * @param task Processes one item; called concurrently from worker threads.
+     */
+    void forEach(size_t count, unsigned threads, const std::function<void(size_t, unsigned)> &task);
+}
+
+#endif // PARALLEL_HPP
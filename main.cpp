@@ -1,29 +1,196 @@
 #include <iostream>
 #include <string>
-#include <unordered_map>
 #include <filesystem>
 #include <chrono>
+#include <fstream>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <span>
+#include <functional>
 #include "lzw.hpp"
 #include "huffman.hpp"
+#include "histogram.hpp"
+#include "archive.hpp"
+#include "mapped_file.hpp"
 
 namespace fs = std::filesystem;
 using namespace std::chrono;
 
+// Path naming standard input or standard output
+const std::string STANDARD_STREAM = "-";
+
+// Huffman block size for standard input when --block-size is not given, so coding starts before the input ends
+constexpr size_t STREAM_BLOCK_SIZE = size_t{1} << 20;
+
 void printUsage()
 {
     std::cout << "Usage:\n"
-              << "  compressor --algorithm lzw/huffman --mode compress/decompress -i <input_file_or_folder> -o <output_file_or_folder>\n";
+              << "  compressor --algorithm lzw/huffman --mode compress/decompress -i <input_file_or_folder> -o <output_file_or_folder> [options]\n"
+              << "  compressor --mode stats -i <input_file>\n"
+              << "  compressor --mode list -i <folder_archive>\n"
+              << "  compressor --mode extract -i <folder_archive> -e <path_in_archive> -o <output_file>\n"
+              << "  compressor --algorithm lzw/huffman --mode train -i <sample_file_or_folder> -o <dictionary_file>\n"
+              << "Files (not folders) can be '-' for standard input or output; status messages then go to standard error.\n"
+              << "Options:\n"
+              << "  --dict-bits, -d <bits>          LZW dictionary size as a power of two (" << lzw::LZW::MIN_CODE_BITS << "-" << lzw::LZW::MAX_CODE_BITS
+              << ", default " << lzw::LZW::DEFAULT_CODE_BITS << ")\n"
+              << "  --max-code-length, -l <bits>   Huffman code length cap (" << huffman::MIN_CODE_LENGTH_LIMIT << "-" << huffman::MAX_CODE_LENGTH
+              << ", default " << huffman::DEFAULT_MAX_CODE_LENGTH << ")\n"
+              << "  --streams, -s <1|4>             Huffman bitstreams per file; 4 interleaves independent streams for faster decoding (default 1)\n"
+              << "  --block-size, -b <KiB>          Block mode: code the input in independent blocks of this size (own Huffman table or LZW dictionary each)\n"
+              << "  --threads, -t <count>           Worker threads for blocks and folder archives, 0 for one per core (default 1)\n"
+              << "  --dictionary, -D <file>         Trained dictionary written by train mode: LZW phrases seeding the dictionary, or a Huffman table used instead of one per block\n";
+}
+
+// Print byte statistics of a file and benchmark the histogram kernel on it
+void printStats(const std::string &inputPath)
+{
+    // Count straight from a memory mapping; copy the input only when it cannot be mapped
+    const io::MappedFile mapping(inputPath);
+    std::vector<uint8_t> copy;
+    if (!mapping.mapped())
+    {
+        std::ifstream input(inputPath, std::ios::binary);
+        copy.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    const std::span<const uint8_t> buffer = mapping.mapped() ? std::span<const uint8_t>(mapping.data(), mapping.size())
+                                                             : std::span<const uint8_t>(copy);
+
+    histogram::Histogram counts{};
+    histogram::count(buffer.data(), buffer.size(), counts);
+    size_t distinct = 0;
+    for (uint64_t value : counts)
+    {
+        distinct += value != 0;
+    }
+    const double entropy = histogram::entropy(counts);
+
+    // Repeat the kernel until about 1 GB has been counted (3 to 1000 passes, so small files finish quickly)
+    const size_t passes = std::clamp<size_t>((size_t{1} << 30) / std::max<size_t>(buffer.size(), 1), 3, 1000);
+    histogram::Histogram scratch{};
+    auto start = high_resolution_clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        histogram::count(buffer.data(), buffer.size(), scratch);
+    }
+    const double seconds = duration<double>(high_resolution_clock::now() - start).count();
+    const double bytesCounted = static_cast<double>(buffer.size()) * static_cast<double>(passes);
+
+    std::cout << "Input size: " << buffer.size() << " bytes\n"
+              << "Distinct bytes: " << distinct << "\n"
+              << "Entropy: " << std::fixed << std::setprecision(4) << entropy << " bits/byte\n"
+              << "Order-0 bound: " << static_cast<size_t>(entropy * static_cast<double>(buffer.size()) / 8.0) << " bytes\n"
+              << "Histogram throughput: " << std::setprecision(2) << (seconds > 0 ? bytesCounted / seconds / 1e9 : 0.0)
+              << " GB/s (" << passes << " passes, checksum " << scratch[0] << ")\n";
+}
+
+// Print the central directory of a folder archive
+void printListing(const std::string &inputPath)
+{
+    const std::vector<archive::Entry> entries = archive::list(inputPath);
+    size_t originalTotal = 0;
+    size_t compressedTotal = 0;
+    std::cout << std::setw(12) << "Original" << std::setw(12) << "Compressed" << "  Codec    Path\n";
+    for (const archive::Entry &entry : entries)
+    {
+        std::cout << std::setw(12) << entry.originalSize << std::setw(12) << entry.size << "  " << std::left << std::setw(9)
+                  << archive::codecName(entry.codec) << std::right << entry.path << "\n";
+        originalTotal += entry.originalSize;
+        compressedTotal += entry.size;
+    }
+    std::cout << std::setw(12) << originalTotal << std::setw(12) << compressedTotal << "  " << entries.size() << " files\n";
+}
+
+// Run write on outputPath, or on standard output for "-"
+void writeOutput(const std::string &outputPath, const std::function<void(std::ostream &)> &write)
+{
+    if (outputPath != STANDARD_STREAM)
+    {
+        io::OutputFile output(outputPath);
+        write(output.stream());
+        output.close();
+        return;
+    }
+    write(std::cout);
+    if (!std::cout.flush())
+    {
+        throw std::runtime_error("Failed to write standard output");
+    }
+}
+
+// Decode one file of a folder archive with the codec recorded in its directory entry
+void extractFromArchive(const std::string &inputPath, const std::string &entryPath, const std::string &outputPath,
+                        const std::string &dictionaryPath)
+{
+    const std::vector<archive::Entry> entries = archive::list(inputPath);
+    const auto entry = std::find_if(entries.begin(), entries.end(), [&](const archive::Entry &candidate)
+                                    { return candidate.path == entryPath; });
+    if (entry == entries.end())
+    {
+        throw std::runtime_error("No such file in archive: " + entryPath);
+    }
+
+    fs::path outPath(outputPath);
+    if (outputPath != STANDARD_STREAM && outPath.has_parent_path() && !fs::exists(outPath.parent_path()))
+    {
+        fs::create_directories(outPath.parent_path());
+    }
+
+    // Files are written by the archive; standard output goes through the stream overload
+    const auto extract = [&](const archive::Decoder &decode)
+    {
+        if (outputPath == STANDARD_STREAM)
+        {
+            writeOutput(outputPath, [&](std::ostream &output)
+                        { archive::extractEntry(inputPath, *entry, output, decode); });
+            return;
+        }
+        archive::extractEntry(inputPath, *entry, outputPath, decode);
+    };
+
+    // The dictionary file holds whatever the entry's codec was trained with
+    if (entry->codec == archive::Codec::Lzw)
+    {
+        lzw::TrainedDictionary dictionary;
+        if (!dictionaryPath.empty())
+        {
+            dictionary = lzw::loadDictionary(dictionaryPath);
+        }
+        lzw::LZW decoder(lzw::LZW::DEFAULT_CODE_BITS, 1, 0, dictionaryPath.empty() ? nullptr : &dictionary);
+        extract([&decoder](std::istream &in, std::ostream &out, unsigned)
+                { decoder.decompressStream(in, out); });
+    }
+    else
+    {
+        huffman::TrainedTable trained;
+        if (!dictionaryPath.empty())
+        {
+            trained = huffman::loadTable(dictionaryPath);
+        }
+        const huffman::TrainedTable *table = dictionaryPath.empty() ? nullptr : &trained;
+        extract([table](std::istream &in, std::ostream &out, unsigned)
+                { huffman::decompressStream(in, out, 1, table); });
+    }
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc < 9 || argc > 10)
+    // Compressed data may pass through std::cin and std::cout, which then need no stdio synchronization
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    if (argc < 3 || argc % 2 == 0)
     {
         printUsage();
         return 1;
     }
 
-    std::string algorithm, mode, inputPath, outputPath;
+    std::string algorithm, mode, inputPath, outputPath, entryPath, dictionaryPath;
+    huffman::CompressOptions huffmanOptions;
+    unsigned lzwCodeBits = lzw::LZW::DEFAULT_CODE_BITS;
+    unsigned threads = 1;
+    size_t blockSize = 0;
 
     for (int i = 1; i < argc; i += 2)
     {
@@ -44,6 +211,79 @@ int main(int argc, char *argv[])
         {
             outputPath = argv[i + 1];
         }
+        else if (arg == "--entry" || arg == "-e")
+        {
+            entryPath = argv[i + 1];
+        }
+        else if (arg == "--dictionary" || arg == "-D")
+        {
+            dictionaryPath = argv[i + 1];
+        }
+        else if (arg == "--max-code-length" || arg == "-l")
+        {
+            try
+            {
+                huffmanOptions.maxCodeLength = static_cast<unsigned>(std::stoul(argv[i + 1]));
+            }
+            catch (const std::exception &)
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (arg == "--block-size" || arg == "-b")
+        {
+            try
+            {
+                blockSize = static_cast<size_t>(std::stoull(argv[i + 1])) << 10;
+            }
+            catch (const std::exception &)
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (arg == "--dict-bits" || arg == "-d")
+        {
+            try
+            {
+                lzwCodeBits = static_cast<unsigned>(std::stoul(argv[i + 1]));
+            }
+            catch (const std::exception &)
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (arg == "--threads" || arg == "-t")
+        {
+            try
+            {
+                threads = static_cast<unsigned>(std::stoul(argv[i + 1]));
+            }
+            catch (const std::exception &)
+            {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (arg == "--streams" || arg == "-s")
+        {
+            const std::string streams = argv[i + 1];
+            if (streams == "1")
+            {
+                huffmanOptions.layout = huffman::Layout::SingleStream;
+            }
+            else if (streams == "4")
+            {
+                huffmanOptions.layout = huffman::Layout::FourStreams;
+            }
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
         else
         {
             printUsage();
@@ -51,38 +291,124 @@ int main(int argc, char *argv[])
         }
     }
 
+    const bool archiveMode = mode == "list" || mode == "extract";
+    if (inputPath.empty() || (mode != "stats" && !archiveMode && (algorithm.empty() || outputPath.empty())) ||
+        (mode == "extract" && (entryPath.empty() || outputPath.empty())))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Folder archives are written and read by seeking, so folders need real paths on both ends
+    const bool streaming = inputPath == STANDARD_STREAM || outputPath == STANDARD_STREAM;
+    if (streaming && (mode == "compress" || mode == "decompress") &&
+        (fs::is_directory(inputPath) || inputPath.ends_with(".folder.lzw") || inputPath.ends_with(".folder.huff")))
+    {
+        std::cerr << "Error: Folders and folder archives cannot use standard input or output.\n";
+        return 1;
+    }
+
+    // Keep standard output for the data when it is the output
+    std::ostream &status = outputPath == STANDARD_STREAM ? std::cerr : std::cout;
+
     try
     {
         auto start = high_resolution_clock::now();
-        lzw::LZW compressor;
+        huffmanOptions.threads = threads;
+        huffmanOptions.blockSize = blockSize;
 
-        if (algorithm == "lzw")
+        // A trained dictionary or table is loaded once and shared by every file and block
+        lzw::TrainedDictionary dictionary;
+        huffman::TrainedTable table;
+        const lzw::TrainedDictionary *trainedDictionary = nullptr;
+        const huffman::TrainedTable *trainedTable = nullptr;
+        if (!dictionaryPath.empty() && (mode == "compress" || mode == "decompress"))
         {
-            if (mode == "compress")
+            if (algorithm == "lzw")
             {
-                if (fs::is_directory(inputPath))
+                dictionary = lzw::loadDictionary(dictionaryPath);
+                trainedDictionary = &dictionary;
+            }
+            else if (algorithm == "huffman")
+            {
+                table = huffman::loadTable(dictionaryPath);
+                trainedTable = &table;
+                huffmanOptions.table = trainedTable;
+            }
+        }
+        lzw::LZW compressor(lzwCodeBits, threads, blockSize, trainedDictionary);
+
+        if (mode == "stats")
+        {
+            printStats(inputPath);
+        }
+        else if (mode == "list")
+        {
+            printListing(inputPath);
+        }
+        else if (mode == "extract")
+        {
+            extractFromArchive(inputPath, entryPath, outputPath, dictionaryPath);
+            status << "Extracted " << entryPath << " to " << outputPath << std::endl;
+        }
+        else if (algorithm == "lzw")
+        {
+            if (mode == "train")
+            {
+                const lzw::TrainedDictionary trained = lzw::trainDictionary(inputPath, lzwCodeBits);
+                lzw::saveDictionary(trained, outputPath);
+                status << "Trained dictionary " << std::hex << std::setw(8) << std::setfill('0') << trained.id << std::dec
+                       << std::setfill(' ') << " (" << trained.prefixes.size() << " phrases): " << outputPath << std::endl;
+            }
+            else if (mode == "compress")
+            {
+                if (streaming)
+                {
+                    // The single-stream coder reads its input in pieces and ends with END, so it never needs the size
+                    writeOutput(outputPath, [&](std::ostream &out)
+                                {
+                                    if (inputPath == STANDARD_STREAM)
+                                    {
+                                        compressor.compressStream(std::cin, out);
+                                        return;
+                                    }
+                                    compressor.compressFile(inputPath, out); });
+                }
+                else if (fs::is_directory(inputPath))
                 {
-                    std::cout << "Compressing folder: " << inputPath << std::endl;
+                    status << "Compressing folder: " << inputPath << std::endl;
                     compressor.compressFolder(inputPath, outputPath);
                 }
                 else
                 {
                     compressor.compress(inputPath, outputPath);
-                    std::cout << "Compression file: " << inputPath << std::endl;
+                    status << "Compression file: " << inputPath << std::endl;
                 }
-                std::cout << "Compression successful: " << outputPath << std::endl;
+                status << "Compression successful: " << outputPath << std::endl;
             }
             else if (mode == "decompress")
             {
+                if (streaming)
+                {
+                    writeOutput(outputPath, [&](std::ostream &out)
+                                {
+                                    if (inputPath == STANDARD_STREAM)
+                                    {
+                                        compressor.decompressStream(std::cin, out);
+                                        return;
+                                    }
+                                    io::InputFile input(inputPath);
+                                    compressor.decompressStream(input.stream(), out); });
+                }
                 // Check if the input file has .folder.lzw extension
-                if (inputPath.ends_with(".folder.lzw"))
+                else if (inputPath.ends_with(".folder.lzw"))
                 {
                     // Create output directory if it doesn't exist
                     if (!fs::exists(outputPath))
                     {
                         fs::create_directories(outputPath);
                     }
-                    std::cout << "Decompressing folder archive: " << inputPath << std::endl;
+                    status << "Decompressing folder archive: " << inputPath << std::endl;
                     compressor.decompressFolder(inputPath, outputPath);
                 }
                 else
@@ -94,45 +420,81 @@ int main(int argc, char *argv[])
                     {
                         fs::create_directories(outPath.parent_path());
                     }
-                    std::cout << "Decompressing file: " << inputPath << std::endl;
+                    status << "Decompressing file: " << inputPath << std::endl;
                     compressor.decompress(inputPath, outputPath);
                 }
-                std::cout << "Decompression successful: " << outputPath << std::endl;
+                status << "Decompression successful: " << outputPath << std::endl;
             }
             else
             {
-                std::cerr << "Error: Invalid mode. Use 'compress' or 'decompress'.\n";
+                std::cerr << "Error: Invalid mode. Use 'compress', 'decompress' or 'train'.\n";
                 return 1;
             }
         }
         else if (algorithm == "huffman")
         {
-            if (mode == "compress")
+            if (mode == "train")
             {
-                if (fs::is_directory(inputPath))
+                const huffman::TrainedTable trained = huffman::trainTable(inputPath, huffmanOptions.maxCodeLength);
+                huffman::saveTable(trained, outputPath);
+                status << "Trained table " << std::hex << std::setw(8) << std::setfill('0') << trained.id << std::dec
+                       << std::setfill(' ') << ": " << outputPath << std::endl;
+            }
+            else if (mode == "compress")
+            {
+                if (streaming)
                 {
-                    std::cout << "Compressing folder: " << inputPath << std::endl;
-                    huffman::compressFolder(inputPath, outputPath);
+                    // Block mode codes standard input as it arrives instead of reading all of it first
+                    huffman::CompressOptions streamOptions = huffmanOptions;
+                    if (inputPath == STANDARD_STREAM && streamOptions.blockSize == 0)
+                    {
+                        streamOptions.blockSize = STREAM_BLOCK_SIZE;
+                    }
+                    writeOutput(outputPath, [&](std::ostream &out)
+                                {
+                                    if (inputPath == STANDARD_STREAM)
+                                    {
+                                        huffman::compressStream(std::cin, out, streamOptions);
+                                        return;
+                                    }
+                                    huffman::compressFile(inputPath, out, streamOptions); });
+                }
+                else if (fs::is_directory(inputPath))
+                {
+                    status << "Compressing folder: " << inputPath << std::endl;
+                    huffman::compressFolder(inputPath, outputPath, huffmanOptions);
                 }
                 else
                 {
-                    huffman::compress(inputPath, outputPath);
-                    std::cout << "Compression file: " << outputPath << std::endl;
+                    huffman::compress(inputPath, outputPath, huffmanOptions);
+                    status << "Compression file: " << outputPath << std::endl;
                 }
-                std::cout << "Compression successful: " << outputPath << std::endl;
+                status << "Compression successful: " << outputPath << std::endl;
             }
             else if (mode == "decompress")
             {
+                if (streaming)
+                {
+                    writeOutput(outputPath, [&](std::ostream &out)
+                                {
+                                    if (inputPath == STANDARD_STREAM)
+                                    {
+                                        huffman::decompressStream(std::cin, out, threads, trainedTable);
+                                        return;
+                                    }
+                                    io::InputFile input(inputPath);
+                                    huffman::decompressStream(input.stream(), out, threads, trainedTable); });
+                }
                 // Check if the input file has .folder.huff extension
-                if(inputPath.ends_with(".folder.huff"))
+                else if(inputPath.ends_with(".folder.huff"))
                 {
                     // Create output directory if it doesn't exist
                     if (!fs::exists(outputPath))
                     {
                         fs::create_directories(outputPath);
                     }
-                    std::cout << "Decompressing folder archive: " << inputPath << std::endl;
-                    huffman::decompressFolder(inputPath, outputPath);
+                    status << "Decompressing folder archive: " << inputPath << std::endl;
+                    huffman::decompressFolder(inputPath, outputPath, threads, trainedTable);
                 }else {
                     // Handle single file decompression
                     fs::path outPath(outputPath);
@@ -141,14 +503,14 @@ int main(int argc, char *argv[])
                     {
                         fs::create_directories(outPath.parent_path());
                     }
-                    std::cout << "Decompressing file: " << inputPath << std::endl;
-                    huffman::decompress(inputPath, outputPath);
+                    status << "Decompressing file: " << inputPath << std::endl;
+                    huffman::decompress(inputPath, outputPath, threads, trainedTable);
                 }
-                std::cout << "Decompression successful: " << outputPath << std::endl;
+                status << "Decompression successful: " << outputPath << std::endl;
             }
             else
             {
-                std::cerr << "Error: Invalid mode. Use 'compress' or 'decompress'.\n";
+                std::cerr << "Error: Invalid mode. Use 'compress', 'decompress' or 'train'.\n";
                 return 1;
             }
         }
@@ -160,7 +522,7 @@ int main(int argc, char *argv[])
 
         auto stop = high_resolution_clock::now();
         auto duration = duration_cast<milliseconds>(stop - start);
-        std::cout << "Execution time: " << duration.count() << " ms" << std::endl;
+        status << "Execution time: " << duration.count() << " ms" << std::endl;
     }
     catch (const std::exception &e)
     {
@@ -0,0 +1,385 @@
+#include "archive.hpp"
+#include "parallel.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace archive
+{
+    namespace
+    {
+        // Upper bound on a stored path, to reject corrupt lengths before allocating
+        constexpr size_t MAX_PATH_LENGTH = 1 << 16;
+
+        template <typename T>
+        void writeValue(std::ostream &out, const T &value)
+        {
+            out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        template <typename T>
+        T readValue(std::istream &in)
+        {
+            T value{};
+            if (!in.read(reinterpret_cast<char *>(&value), sizeof(value)))
+            {
+                throw std::runtime_error("Truncated archive index");
+            }
+            return value;
+        }
+
+        // Entry paths must stay inside the output folder
+        bool isSafePath(const std::string &path)
+        {
+            const fs::path relative(path);
+            if (path.empty() || relative.is_absolute() || relative.has_root_name())
+            {
+                return false;
+            }
+            return std::none_of(relative.begin(), relative.end(), [](const fs::path &part)
+                                { return part == ".."; });
+        }
+
+        /**
+         * @brief Read-only file descriptor, closed on destruction.
+         */
+        class Descriptor
+        {
+        public:
+            explicit Descriptor(const std::string &path) : fd(::open(path.c_str(), O_RDONLY)) {}
+            ~Descriptor()
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+            Descriptor(const Descriptor &) = delete;
+            Descriptor &operator=(const Descriptor &) = delete;
+
+            int get() const { return fd; }
+
+        private:
+            int fd;
+        };
+
+        /**
+         * @brief Stream buffer over one byte range of a file, filled with pread so any number of them can
+         * share a descriptor across threads.
+         */
+        class RangeBuffer : public std::streambuf
+        {
+        public:
+            RangeBuffer(int descriptor, size_t offset, size_t size) : fd(descriptor), position(offset), end(offset + size) {}
+
+        protected:
+            int_type underflow() override
+            {
+                if (gptr() < egptr())
+                {
+                    return traits_type::to_int_type(*gptr());
+                }
+                if (position == end)
+                {
+                    return traits_type::eof();
+                }
+                const size_t wanted = std::min(buffer.size(), end - position);
+                const ssize_t got = ::pread(fd, buffer.data(), wanted, static_cast<off_t>(position));
+                if (got <= 0)
+                {
+                    return traits_type::eof();
+                }
+                position += static_cast<size_t>(got);
+                setg(buffer.data(), buffer.data(), buffer.data() + got);
+                return traits_type::to_int_type(*gptr());
+            }
+
+        private:
+            int fd;
+            size_t position;
+            size_t end;
+            std::array<char, size_t{1} << 16> buffer;
+        };
+
+        // Footer magic identifying an archive
+        constexpr std::array<char, 8> MAGIC = {'C', 'O', 'D', 'E', 'A', 'R', 'C', '1'};
+
+        // Smallest directory record: path length, codec, offset, size and original size
+        constexpr size_t MIN_ENTRY_BYTES = 4 * sizeof(size_t) + sizeof(Codec);
+
+        // Decode straight from this entry's range and check that all of it was consumed
+        void decodeRange(int fd, const Entry &entry, std::ostream &out, const Decoder &decode, unsigned worker)
+        {
+            RangeBuffer range(fd, entry.offset, entry.size);
+            std::istream in(&range);
+            decode(in, out, worker);
+            if (in.peek() != std::char_traits<char>::eof())
+            {
+                throw std::runtime_error("Compressed size does not match the archive entry");
+            }
+        }
+
+        // Decode one entry from the archive descriptor into outputPath
+        void decodeEntry(int fd, const Entry &entry, const fs::path &outputPath, const Decoder &decode, unsigned worker)
+        {
+            try
+            {
+                io::OutputFile output(outputPath.string());
+                decodeRange(fd, entry, output.stream(), decode, worker);
+                output.close();
+            }
+            catch (const std::exception &e)
+            {
+                throw std::runtime_error("Error processing file " + entry.path + ": " + e.what());
+            }
+        }
+    } // namespace
+
+    const char *codecName(Codec codec)
+    {
+        switch (codec)
+        {
+        case Codec::Lzw:
+            return "lzw";
+        case Codec::Huffman:
+            return "huffman";
+        }
+        return "unknown";
+    }
+
+    std::vector<Entry> readIndex(std::istream &in)
+    {
+        // The footer holds the offset of the directory and the magic
+        in.seekg(0, std::ios::end);
+        const std::streamoff archiveSize = in.tellg();
+        constexpr size_t FOOTER_SIZE = sizeof(size_t) + MAGIC.size();
+        if (archiveSize < static_cast<std::streamoff>(FOOTER_SIZE + sizeof(size_t)))
+        {
+            throw std::runtime_error("Not a folder archive");
+        }
+        const size_t footerOffset = static_cast<size_t>(archiveSize) - FOOTER_SIZE;
+        in.seekg(static_cast<std::streamoff>(footerOffset));
+        const size_t indexOffset = readValue<size_t>(in);
+        const auto magic = readValue<std::array<char, MAGIC.size()>>(in);
+        if (magic != MAGIC)
+        {
+            throw std::runtime_error("Not a folder archive");
+        }
+        if (indexOffset > footerOffset - sizeof(size_t))
+        {
+            throw std::runtime_error("Invalid archive index offset");
+        }
+
+        in.seekg(static_cast<std::streamoff>(indexOffset));
+        const size_t fileCount = readValue<size_t>(in);
+        if (fileCount > (footerOffset - indexOffset) / MIN_ENTRY_BYTES)
+        {
+            throw std::runtime_error("Invalid archive file count");
+        }
+
+        std::vector<Entry> entries(fileCount);
+        for (Entry &entry : entries)
+        {
+            const size_t pathLength = readValue<size_t>(in);
+            if (pathLength > MAX_PATH_LENGTH)
+            {
+                throw std::runtime_error("Invalid path length in archive index");
+            }
+            entry.path.resize(pathLength);
+            if (!in.read(entry.path.data(), static_cast<std::streamsize>(pathLength)))
+            {
+                throw std::runtime_error("Truncated archive index");
+            }
+            entry.codec = readValue<Codec>(in);
+            entry.offset = readValue<size_t>(in);
+            entry.size = readValue<size_t>(in);
+            entry.originalSize = readValue<size_t>(in);
+            if (entry.codec != Codec::Lzw && entry.codec != Codec::Huffman)
+            {
+                throw std::runtime_error("Unknown codec in archive: " + entry.path);
+            }
+            if (entry.offset > indexOffset || entry.size > indexOffset - entry.offset)
+            {
+                throw std::runtime_error("Archive entry out of range: " + entry.path);
+            }
+            if (!isSafePath(entry.path))
+            {
+                throw std::runtime_error("Unsafe path in archive: " + entry.path);
+            }
+        }
+        return entries;
+    }
+
+    std::vector<Entry> list(const std::string &inputFile)
+    {
+        std::ifstream inFile(inputFile, std::ios::binary);
+        if (!inFile)
+        {
+            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+        }
+        try
+        {
+            return readIndex(inFile);
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(std::string(e.what()) + ": " + inputFile);
+        }
+    }
+
+    void create(const std::string &inputFolder, const std::string &outputFile, Codec codec, unsigned threads, const Encoder &encode)
+    {
+        if (!fs::exists(inputFolder))
+        {
+            throw std::runtime_error("Input folder does not exist: " + inputFolder);
+        }
+
+        io::OutputFile output(outputFile);
+        std::ostream &outFile = output.stream();
+
+        // Collect all files including those in subfolders, in path order so the output does not depend on
+        // directory iteration order
+        std::vector<fs::path> files;
+        for (const auto &entry : fs::recursive_directory_iterator(inputFolder))
+        {
+            if (entry.is_regular_file())
+            {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+
+        // Get base path for relative path calculation
+        const fs::path basePath = fs::canonical(inputFolder);
+
+        // Compress files on worker threads; their data is appended by this thread in file order
+        std::vector<Entry> entries;
+        entries.reserve(files.size());
+        std::vector<size_t> originalSizes(files.size()); // Filled by the worker that compresses each file
+        size_t offset = 0;
+        parallel::orderedMap(
+            files.size(), threads,
+            [&](size_t index)
+            {
+                try
+                {
+                    originalSizes[index] = static_cast<size_t>(fs::file_size(files[index]));
+                    std::ostringstream compressed;
+                    encode(files[index].string(), compressed);
+                    return std::move(compressed).str();
+                }
+                catch (const std::exception &e)
+                {
+                    throw std::runtime_error("Error processing file " + files[index].string() + ": " + e.what());
+                }
+            },
+            [&](size_t index, std::string &compressed)
+            {
+                const fs::path relativePath = fs::canonical(files[index]).lexically_relative(basePath);
+                entries.push_back(Entry{relativePath.generic_string(), codec, offset, compressed.size(), originalSizes[index]});
+                outFile.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+                offset += compressed.size();
+                if (!outFile)
+                {
+                    throw std::runtime_error("Failed to write output file: " + outputFile);
+                }
+            });
+
+        // Write the central directory and the footer pointing at it
+        writeValue(outFile, entries.size());
+        for (const Entry &entry : entries)
+        {
+            writeValue(outFile, entry.path.size());
+            outFile.write(entry.path.data(), static_cast<std::streamsize>(entry.path.size()));
+            writeValue(outFile, entry.codec);
+            writeValue(outFile, entry.offset);
+            writeValue(outFile, entry.size);
+            writeValue(outFile, entry.originalSize);
+        }
+        writeValue(outFile, offset);
+        writeValue(outFile, MAGIC);
+        output.close();
+    }
+
+    void extract(const std::string &inputFile, const std::string &outputFolder, Codec codec, unsigned threads, const Decoder &decode)
+    {
+        if (!fs::exists(inputFile))
+        {
+            throw std::runtime_error("Input file does not exist: " + inputFile);
+        }
+
+        const std::vector<Entry> entries = list(inputFile);
+        for (const Entry &entry : entries)
+        {
+            if (entry.codec != codec)
+            {
+                throw std::runtime_error("Archive entry " + entry.path + " was compressed with " + codecName(entry.codec));
+            }
+        }
+
+        const Descriptor archiveFile(inputFile);
+        if (archiveFile.get() < 0)
+        {
+            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+        }
+
+        // Remove output folder if it exists and create it fresh
+        if (fs::exists(outputFolder))
+        {
+            fs::remove_all(outputFolder);
+        }
+        if (!fs::create_directory(outputFolder))
+        {
+            throw std::runtime_error("Failed to create output directory: " + outputFolder);
+        }
+
+        // Create every directory before the workers start writing files
+        for (const Entry &entry : entries)
+        {
+            fs::create_directories((fs::path(outputFolder) / entry.path).parent_path());
+        }
+
+        parallel::forEach(
+            entries.size(), threads,
+            [&](size_t index, unsigned worker)
+            {
+                const Entry &entry = entries[index];
+                decodeEntry(archiveFile.get(), entry, fs::path(outputFolder) / entry.path, decode, worker);
+            });
+    }
+
+    void extractEntry(const std::string &inputFile, const Entry &entry, const std::string &outputFile, const Decoder &decode)
+    {
+        const Descriptor archiveFile(inputFile);
+        if (archiveFile.get() < 0)
+        {
+            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+        }
+        decodeEntry(archiveFile.get(), entry, outputFile, decode, 0);
+    }
+
+    void extractEntry(const std::string &inputFile, const Entry &entry, std::ostream &output, const Decoder &decode)
+    {
+        const Descriptor archiveFile(inputFile);
+        if (archiveFile.get() < 0)
+        {
+            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+        }
+        try
+        {
+            decodeRange(archiveFile.get(), entry, output, decode, 0);
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error("Error processing file " + entry.path + ": " + e.what());
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#include "bit_io.hpp"
+#include <stdexcept>
+
+namespace io
+{
+    // Slack past the limit for the 32-bit store that crosses it
+    StreamBitWriter::StreamBitWriter(std::ostream &output)
+        : out(&output), buffer(BUFFER_SIZE + 8), limit(buffer.data() + BUFFER_SIZE), writer(buffer.data()) {}
+
+    void StreamBitWriter::flush()
+    {
+        writer.flush();
+        drain();
+    }
+
+    void StreamBitWriter::reset(std::ostream &output)
+    {
+        out = &output;
+        writer = BitWriter(buffer.data());
+    }
+
+    // Hand every completed byte to the stream in one write and start over at the front of the buffer
+    void StreamBitWriter::drain()
+    {
+        out->write(reinterpret_cast<const char *>(buffer.data()), writer.out - buffer.data());
+        writer.out = buffer.data();
+    }
+
+    StreamBitReader::StreamBitReader(std::istream &input, std::vector<uint8_t> &storage) : in(input), buffer(storage)
+    {
+        if (buffer.size() < BUFFER_SIZE)
+        {
+            buffer.resize(BUFFER_SIZE);
+        }
+    }
+
+    // Whole bytes still buffered belong to whatever follows the codes; the partial byte is padding
+    bool StreamBitReader::returnUnread()
+    {
+        const size_t unread = size - pos + available / 8;
+        pos = size;
+        available = 0;
+        accumulator = 0;
+        if (unread == 0)
+        {
+            return true;
+        }
+        if (in.bad())
+        {
+            return false;
+        }
+        // The read ahead may have hit the end of the stream, which must not stop the seek
+        in.clear();
+        in.seekg(-static_cast<std::streamoff>(unread), std::ios::cur);
+        if (!in)
+        {
+            in.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Top the accumulator up to at least width bits, four bytes at a time while the buffer allows it
+    void StreamBitReader::refill(unsigned width)
+    {
+        while (available < width)
+        {
+            if (available <= 32 && pos + 4 <= size)
+            {
+                const uint8_t *p = buffer.data() + pos;
+                const uint32_t word = (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+                accumulator = (accumulator << 32) | word;
+                pos += 4;
+                available += 32;
+                continue;
+            }
+            if (pos == size)
+            {
+                in.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+                size = static_cast<size_t>(in.gcount());
+                pos = 0;
+                if (size == 0)
+                {
+                    throw std::runtime_error("Truncated bit stream");
+                }
+            }
+            accumulator = (accumulator << 8) | buffer[pos++];
+            available += 8;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#include "histogram.hpp"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace histogram
+{
+    namespace
+    {
+        constexpr size_t TABLE_COUNT = 4;
+        constexpr size_t CHUNK_SIZE = size_t{1} << 30; // Keeps every 32-bit counter below 2^30
+
+        // Count one chunk into the interleaved tables
+        void countChunk(const uint8_t *data, size_t size, std::array<std::array<uint32_t, BYTE_VALUES>, TABLE_COUNT> &tables)
+        {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16)
+            {
+                uint64_t first;
+                uint64_t second;
+                std::memcpy(&first, data + i, sizeof(first));
+                std::memcpy(&second, data + i + 8, sizeof(second));
+                for (unsigned shift = 0; shift < 64; shift += 16)
+                {
+                    tables[0][(first >> shift) & 0xFF]++;
+                    tables[1][(first >> (shift + 8)) & 0xFF]++;
+                    tables[2][(second >> shift) & 0xFF]++;
+                    tables[3][(second >> (shift + 8)) & 0xFF]++;
+                }
+            }
+            for (; i < size; ++i)
+            {
+                tables[i % TABLE_COUNT][data[i]]++;
+            }
+        }
+    } // namespace
+
+    // Count bytes with interleaved tables
+    void count(const uint8_t *data, size_t size, Histogram &counts)
+    {
+        std::array<std::array<uint32_t, BYTE_VALUES>, TABLE_COUNT> tables;
+        while (size > 0)
+        {
+            const size_t chunk = std::min(size, CHUNK_SIZE);
+            for (auto &table : tables)
+            {
+                table.fill(0);
+            }
+            countChunk(data, chunk, tables);
+            for (size_t value = 0; value < BYTE_VALUES; ++value)
+            {
+                counts[value] += uint64_t{tables[0][value]} + tables[1][value] + tables[2][value] + tables[3][value];
+            }
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    // Shannon entropy in bits per byte
+    double entropy(const Histogram &counts)
+    {
+        uint64_t total = 0;
+        for (uint64_t value : counts)
+        {
+            total += value;
+        }
+        if (total == 0)
+        {
+            return 0.0;
+        }
+        double bits = 0.0;
+        for (uint64_t value : counts)
+        {
+            if (value != 0)
+            {
+                const double p = static_cast<double>(value) / static_cast<double>(total);
+                bits -= p * std::log2(p);
+            }
+        }
+        return bits;
+    }
+}
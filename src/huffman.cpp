@@ -1,379 +1,1305 @@
 #include <huffman.hpp>
+#include <archive.hpp>
+#include <parallel.hpp>
+#include <mapped_file.hpp>
+#include <bit_io.hpp>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <unordered_map>
-#include <queue>
-#include <bitset>
 #include <filesystem>
-#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
 
 namespace huffman
 {
-    // Node constructor
-    Node::Node(char ch, int freq) : frequency(freq), character(ch), left(nullptr), right(nullptr) {}
-
-    // Comparison for priority queue
-    bool compare::operator()(Node *left, Node *right)
+    // Count bytes, then build
+    CodeLengths TreeBuilder::build(const uint8_t *data, size_t size)
     {
-        return left->frequency > right->frequency;
+        counts.fill(0);
+        histogram::count(data, size, counts);
+        return build(counts);
     }
 
-    // Build Huffman Tree
-    Node *buildHuffmanTree(const std::string &text)
+    // Two-queue Huffman construction over flat arrays
+    CodeLengths TreeBuilder::build(const Histogram &frequency)
     {
-        std::unordered_map<char, int> freqMap;
-        for (char ch : text)
-            freqMap[ch]++;
-        std::priority_queue<Node *, std::vector<Node *>, compare> minHeap;
-        for (const auto &pair : freqMap)
+        CodeLengths lengths{};
+
+        // Leaves in ascending frequency, ties broken by byte value so the result is deterministic
+        size_t leafCount = 0;
+        for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+        {
+            if (frequency[symbol] != 0)
+            {
+                leafSymbol[leafCount++] = static_cast<uint8_t>(symbol);
+            }
+        }
+        if (leafCount == 0)
+        {
+            return lengths;
+        }
+        if (leafCount == 1)
+        {
+            lengths[leafSymbol[0]] = 1; // A lone symbol still needs one bit
+            return lengths;
+        }
+        std::sort(leafSymbol.begin(), leafSymbol.begin() + leafCount, [&frequency](uint8_t a, uint8_t b)
+                  { return frequency[a] != frequency[b] ? frequency[a] < frequency[b] : a < b; });
+        for (size_t i = 0; i < leafCount; ++i)
+        {
+            weight[i] = frequency[leafSymbol[i]];
+        }
+
+        // Repeatedly merge the two lightest nodes from the fronts of the two queues
+        size_t nextLeaf = 0;
+        size_t nextMerged = leafCount;
+        const size_t root = 2 * leafCount - 2;
+        for (size_t merged = leafCount; merged <= root; ++merged)
         {
-            minHeap.push(new Node(pair.first, pair.second));
+            uint64_t total = 0;
+            for (int child = 0; child < 2; ++child)
+            {
+                size_t pick;
+                if (nextLeaf < leafCount && (nextMerged == merged || weight[nextLeaf] <= weight[nextMerged]))
+                {
+                    pick = nextLeaf++;
+                }
+                else
+                {
+                    pick = nextMerged++;
+                }
+                parent[pick] = static_cast<uint16_t>(merged);
+                total += weight[pick];
+            }
+            weight[merged] = total;
         }
-        while (minHeap.size() > 1)
+
+        // Parents always come after their children, so one backward pass resolves all depths
+        depth[root] = 0;
+        for (size_t node = root; node-- > 0;)
         {
-            Node *left = minHeap.top();
-            minHeap.pop();
-            Node *right = minHeap.top();
-            minHeap.pop();
-            Node *mergedNode = new Node('\0', left->frequency + right->frequency);
-            mergedNode->left = left;
-            mergedNode->right = right;
-            minHeap.push(mergedNode);
+            depth[node] = static_cast<uint16_t>(depth[parent[node]] + 1);
         }
-        return minHeap.top();
+        for (size_t i = 0; i < leafCount; ++i)
+        {
+            lengths[leafSymbol[i]] = static_cast<uint8_t>(depth[i]);
+        }
+        return lengths;
     }
 
-    void deleteHuffmanTree(Node *root)
+    namespace
     {
-        if (!root)
-            return;
-        deleteHuffmanTree(root->left);  // Delete left subtree
-        deleteHuffmanTree(root->right); // Delete right subtree
-        delete root;                    // Delete the current node
-    }
+        void checkCodeLengthLimit(unsigned maxLength)
+        {
+            if (maxLength < MIN_CODE_LENGTH_LIMIT || maxLength > MAX_CODE_LENGTH)
+            {
+                throw std::invalid_argument("Huffman code length limit must be between " + std::to_string(MIN_CODE_LENGTH_LIMIT) +
+                                            " and " + std::to_string(MAX_CODE_LENGTH));
+            }
+        }
+    } // namespace
 
-    // Generate Huffman codes
-    void print_code(Node *root, const std::string &str, std::unordered_map<char, std::string> &Huffman_tree)
+    // Limit code lengths by rebalancing the number of codes per length
+    void limitCodeLengths(CodeLengths &lengths, unsigned maxLength)
     {
-        if (!root)
+        checkCodeLengthLimit(maxLength);
+
+        std::array<size_t, 256> lengthCount{};
+        unsigned longest = 0;
+        for (uint8_t length : lengths)
+        {
+            if (length != 0)
+            {
+                lengthCount[length]++;
+                longest = std::max<unsigned>(longest, length);
+            }
+        }
+        if (longest <= maxLength)
+        {
             return;
-        if (root->character != '\0')
+        }
+
+        // Move over-long codes up in pairs: the pair's parent replaces a shorter leaf that splits in two
+        for (unsigned length = longest; length > maxLength; --length)
+        {
+            while (lengthCount[length] > 0)
+            {
+                unsigned shorter = length - 2;
+                while (lengthCount[shorter] == 0)
+                {
+                    --shorter;
+                }
+                lengthCount[length] -= 2;
+                lengthCount[length - 1] += 1;
+                lengthCount[shorter + 1] += 2;
+                lengthCount[shorter] -= 1;
+            }
+        }
+
+        // Reassign lengths in the order of the original lengths, ties broken by byte value
+        std::array<uint8_t, SYMBOL_COUNT> order{};
+        size_t used = 0;
+        for (unsigned length = 1; length <= longest; ++length)
         {
-            Huffman_tree[root->character] = str;
+            for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+            {
+                if (lengths[symbol] == length)
+                {
+                    order[used++] = static_cast<uint8_t>(symbol);
+                }
+            }
+        }
+        size_t next = 0;
+        for (unsigned length = 1; length <= maxLength; ++length)
+        {
+            for (size_t i = 0; i < lengthCount[length]; ++i)
+            {
+                lengths[order[next++]] = static_cast<uint8_t>(length);
+            }
         }
-        print_code(root->left, str + "0", Huffman_tree);  // Traverse left
-        print_code(root->right, str + "1", Huffman_tree); // Traverse right
     }
 
-    // Encode text using Huffman codes
-    std::string encode(const std::string &str, const std::unordered_map<char, std::string> &Huffman_tree)
+    // Assign canonical codes: shorter codes first, ties broken by byte value
+    CodeTable canonicalCodes(const CodeLengths &lengths)
     {
-        std::string text;
-        for (char ch : str)
+        std::array<uint64_t, MAX_CODE_LENGTH + 2> lengthCount{};
+        for (uint8_t length : lengths)
+        {
+            lengthCount[length]++;
+        }
+        lengthCount[0] = 0;
+
+        std::array<uint64_t, MAX_CODE_LENGTH + 2> nextCode{};
+        uint64_t code = 0;
+        for (unsigned length = 1; length <= MAX_CODE_LENGTH; ++length)
         {
-            text += Huffman_tree.at(ch);
+            code = (code + lengthCount[length - 1]) << 1;
+            nextCode[length] = code;
+        }
+
+        CodeTable table;
+        table.lengths = lengths;
+        for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+        {
+            if (lengths[symbol] != 0)
+            {
+                table.codes[symbol] = nextCode[lengths[symbol]]++;
+            }
         }
-        return text;
+        return table;
     }
 
-    // Compress a single file
-    void compress(const std::string &inputFile, const std::string &outputFile)
+    // Write the length table as (length, run - 1) pairs, gathered first so the table costs one write
+    void writeCodeLengths(std::ostream &out, const CodeLengths &lengths)
     {
-        std::ifstream inFile(inputFile, std::ios::binary);
-        if (!inFile)
+        std::array<char, 2 * SYMBOL_COUNT> pairs;
+        size_t used = 0;
+        size_t symbol = 0;
+        while (symbol < SYMBOL_COUNT)
         {
-            throw std::runtime_error("Failed to open input file: " + inputFile);
+            size_t run = 1;
+            while (symbol + run < SYMBOL_COUNT && lengths[symbol + run] == lengths[symbol])
+            {
+                ++run;
+            }
+            pairs[used++] = static_cast<char>(lengths[symbol]);
+            pairs[used++] = static_cast<char>(run - 1);
+            symbol += run;
         }
+        out.write(pairs.data(), static_cast<std::streamsize>(used));
+    }
 
-        // Read input file into a string
-        std::ostringstream buffer;
-        buffer << inFile.rdbuf();
-        std::string inputText = buffer.str();
-        inFile.close();
+    // Read the length table back
+    CodeLengths readCodeLengths(std::istream &in)
+    {
+        CodeLengths lengths{};
+        size_t symbol = 0;
+        while (symbol < SYMBOL_COUNT)
+        {
+            char pair[2];
+            if (!in.read(pair, 2))
+            {
+                throw std::runtime_error("Truncated Huffman code length table");
+            }
+            const uint8_t length = static_cast<uint8_t>(pair[0]);
+            const size_t run = static_cast<size_t>(static_cast<uint8_t>(pair[1])) + 1;
+            if (length > MAX_CODE_LENGTH || symbol + run > SYMBOL_COUNT)
+            {
+                throw std::runtime_error("Malformed Huffman code length table");
+            }
+            std::fill_n(lengths.begin() + symbol, run, length);
+            symbol += run;
+        }
+        return lengths;
+    }
 
-        // Build Huffman tree and generate codes
-        Node *root = buildHuffmanTree(inputText);
-        std::unordered_map<char, std::string> huffmanCodes;
-        print_code(root, "", huffmanCodes);
-        std::string encodedText = encode(inputText, huffmanCodes);
+    // Encode text into packed bits
+    size_t encode(const uint8_t *data, size_t size, const CodeTable &codeTable, std::vector<uint8_t> &packed)
+    {
+        // Exact output size from the byte histogram and the code lengths
+        Histogram frequency{};
+        histogram::count(data, size, frequency);
+        size_t bitCount = 0;
+        for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+        {
+            if (frequency[symbol] != 0 && codeTable.lengths[symbol] == 0)
+            {
+                throw std::runtime_error("No Huffman code for byte " + std::to_string(symbol));
+            }
+            bitCount += frequency[symbol] * codeTable.lengths[symbol];
+        }
 
-        // Write compressed data to output file
-        std::ofstream outFile(outputFile, std::ios::binary);
-        if (!outFile)
+        // Slack for the final 32-bit store
+        packed.assign((bitCount + 7) / 8 + 4, 0);
+        io::BitWriter writer(packed.data());
+        for (size_t i = 0; i < size; ++i)
         {
-            throw std::runtime_error("Failed to open output file: " + outputFile);
+            writer.put(codeTable.codes[data[i]], codeTable.lengths[data[i]]);
         }
+        writer.flush();
+        packed.resize((bitCount + 7) / 8);
+        return bitCount;
+    }
+
+    // Build the canonical length tables and the multi-symbol lookup table
+    DecodeTable buildDecodeTable(const CodeLengths &lengths)
+    {
+        DecodeTable table;
+        buildDecodeTable(lengths, table);
+        return table;
+    }
+
+    // Rebuild the tables in place, reusing the lookup entries
+    void buildDecodeTable(const CodeLengths &lengths, DecodeTable &table)
+    {
+        table.lengthCount.fill(0);
+        table.maxLength = 0;
 
-        // Write Huffman codes to the output file
-        size_t mapSize = huffmanCodes.size();
-        outFile.write(reinterpret_cast<const char *>(&mapSize), sizeof(mapSize));
-        for (const auto &pair : huffmanCodes)
+        // Kraft check: reject over-subscribed length sets
+        long double kraft = 0;
+        for (uint8_t length : lengths)
+        {
+            if (length > MAX_CODE_LENGTH)
+            {
+                throw std::runtime_error("Invalid Huffman code length");
+            }
+            if (length != 0)
+            {
+                table.lengthCount[length]++;
+                table.maxLength = std::max<unsigned>(table.maxLength, length);
+                kraft += std::ldexp(1.0L, -static_cast<int>(length));
+            }
+        }
+        if (kraft > 1.0L)
         {
-            outFile.put(pair.first);
-            size_t codeLength = pair.second.size();
-            outFile.write(reinterpret_cast<const char *>(&codeLength), sizeof(codeLength));
-            outFile.write(pair.second.c_str(), codeLength);
+            throw std::runtime_error("Invalid Huffman code lengths");
         }
 
-        // Write encoded text to the output file
-        size_t encodedSize = encodedText.size();
-        outFile.write(reinterpret_cast<const char *>(&encodedSize), sizeof(encodedSize));
+        // Canonical first code and symbol offset of each length
+        uint64_t code = 0;
+        uint16_t index = 0;
+        for (unsigned length = 1; length <= MAX_CODE_LENGTH; ++length)
+        {
+            code = (code + table.lengthCount[length - 1]) << 1;
+            table.firstCode[length] = code;
+            table.firstIndex[length] = index;
+            index = static_cast<uint16_t>(index + table.lengthCount[length]);
+        }
+        std::array<uint16_t, MAX_CODE_LENGTH + 1> fill = table.firstIndex;
+        for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
+        {
+            if (lengths[symbol] != 0)
+            {
+                table.sortedSymbols[fill[lengths[symbol]]++] = static_cast<uint8_t>(symbol);
+            }
+        }
 
-        for (size_t i = 0; i < encodedSize; i += 8)
+        // Single-symbol table: each short code owns a contiguous range of lookup indices
+        const size_t tableSize = size_t{1} << DECODE_TABLE_BITS;
+        table.entries.assign(tableSize, DecodeEntry{});
+        const CodeTable codes = canonicalCodes(lengths);
+        for (size_t symbol = 0; symbol < SYMBOL_COUNT; ++symbol)
         {
-            std::string byteStr = encodedText.substr(i, 8);
-            while (byteStr.size() < 8)
+            const unsigned length = lengths[symbol];
+            if (length == 0 || length > DECODE_TABLE_BITS)
             {
-                byteStr += '0'; // Pad with zeros if necessary
+                continue;
+            }
+            const size_t first = static_cast<size_t>(codes.codes[symbol]) << (DECODE_TABLE_BITS - length);
+            const size_t span = size_t{1} << (DECODE_TABLE_BITS - length);
+            for (size_t i = first; i < first + span; ++i)
+            {
+                table.entries[i] = DecodeEntry{{static_cast<uint8_t>(symbol)}, 1, static_cast<uint8_t>(length), static_cast<uint8_t>(length)};
             }
-            char byte = static_cast<char>(std::bitset<8>(byteStr).to_ulong());
-            outFile.put(byte);
         }
-        outFile.close();
 
-        // Delete the Huffman tree to free memory
-        deleteHuffmanTree(root);
+        // Multi-symbol table: keep decoding the leftover bits of each index. Extending an entry never changes
+        // its first symbol, firstBits or whether it is a long code, so the entries double as the single table.
+        const size_t mask = tableSize - 1;
+        for (size_t i = 0; i < tableSize; ++i)
+        {
+            DecodeEntry &entry = table.entries[i];
+            while (entry.count != 0 && entry.count < DECODE_MAX_SYMBOLS)
+            {
+                const DecodeEntry &next = table.entries[(i << entry.bits) & mask];
+                if (next.count == 0 || entry.bits + next.firstBits > DECODE_TABLE_BITS)
+                {
+                    break;
+                }
+                entry.symbols[entry.count++] = next.symbols[0];
+                entry.bits = static_cast<uint8_t>(entry.bits + next.firstBits);
+            }
+        }
     }
 
-    // Decompress a single file
-    void decompress(const std::string &inputFile, const std::string &outputFile)
+    namespace
     {
-        std::ifstream inFile(inputFile, std::ios::binary);
-        if (!inFile)
+        // Decoding state of one bitstream writing into its own output range
+        struct StreamDecoder
+        {
+            io::BitReader reader;
+            size_t remaining = 0; // Bits not yet decoded
+            char *out = nullptr;
+            char *outEnd = nullptr;
+
+            StreamDecoder() = default;
+
+            StreamDecoder(const uint8_t *data, size_t bitCount, char *output, size_t symbolCount)
+                : reader(data, (bitCount + 7) / 8), remaining(bitCount), out(output), outEnd(output + symbolCount) {}
+
+            // A whole entry can be stored and any code fits in the remaining bits
+            inline bool canDecodeFast(unsigned safeBits) const
+            {
+                return remaining >= safeBits && static_cast<size_t>(outEnd - out) >= DECODE_MAX_SYMBOLS;
+            }
+
+            // Long code: find the length whose canonical range contains the next bits
+            inline void decodeLong(const DecodeTable &table)
+            {
+                for (unsigned length = DECODE_TABLE_BITS + 1; length <= table.maxLength && length <= remaining; ++length)
+                {
+                    const uint64_t offset = reader.peek64(length) - table.firstCode[length];
+                    if (offset < table.lengthCount[length])
+                    {
+                        *out++ = static_cast<char>(table.sortedSymbols[table.firstIndex[length] + offset]);
+                        reader.consume(length);
+                        remaining -= length;
+                        return;
+                    }
+                }
+                throw std::runtime_error("Invalid Huffman code in stream");
+            }
+
+            // Lookups that are certain to stay within canDecodeFast(): each one takes at most safeBits bits and DECODE_MAX_SYMBOLS symbols
+            inline size_t fastSteps(unsigned safeBits) const
+            {
+                if (!canDecodeFast(safeBits))
+                {
+                    return 0;
+                }
+                const size_t byBits = (remaining - safeBits) / safeBits + 1;
+                const size_t bySymbols = (static_cast<size_t>(outEnd - out) - DECODE_MAX_SYMBOLS) / DECODE_MAX_SYMBOLS + 1;
+                return std::min(byBits, bySymbols);
+            }
+
+            // One lookup; only valid while canDecodeFast() holds
+            inline void decodeFast(const DecodeTable &table)
+            {
+                reader.refill();
+                const DecodeEntry &entry = table.entries[reader.peek(DECODE_TABLE_BITS)];
+                if (entry.count != 0)
+                {
+                    std::memcpy(out, entry.symbols, DECODE_MAX_SYMBOLS);
+                    out += entry.count;
+                    reader.consume(entry.bits);
+                    remaining -= entry.bits;
+                }
+                else
+                {
+                    decodeLong(table);
+                }
+            }
+
+            // Finish the stream one symbol at a time with full bounds checks
+            void decodeTail(const DecodeTable &table)
+            {
+                while (remaining > 0 && out < outEnd)
+                {
+                    reader.refill();
+                    const DecodeEntry &entry = table.entries[reader.peek(DECODE_TABLE_BITS)];
+                    if (entry.count != 0 && entry.firstBits <= remaining)
+                    {
+                        *out++ = static_cast<char>(entry.symbols[0]);
+                        reader.consume(entry.firstBits);
+                        remaining -= entry.firstBits;
+                    }
+                    else if (entry.count == 0)
+                    {
+                        decodeLong(table);
+                    }
+                    else
+                    {
+                        throw std::runtime_error("Invalid Huffman code in stream");
+                    }
+                }
+                if (out != outEnd || remaining != 0)
+                {
+                    throw std::runtime_error("Huffman stream does not match its symbol count");
+                }
+            }
+        };
+
+        // Bits that guarantee any entry or code can be consumed without a bounds check
+        inline unsigned safeBits(const DecodeTable &table)
         {
-            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+            return std::max(DECODE_TABLE_BITS, table.maxLength);
         }
+    } // namespace
 
-        // Read Huffman codes from the input file
-        size_t mapSize;
-        inFile.read(reinterpret_cast<char *>(&mapSize), sizeof(mapSize));
-        std::unordered_map<std::string, char> reverseHuffmanCodes;
-        for (size_t i = 0; i < mapSize; ++i)
+    // Decode a packed bitstream using the lookup table, falling back to canonical decoding for long codes
+    void decodeBits(const DecodeTable &table, const uint8_t *data, size_t bitCount, char *out, size_t symbolCount)
+    {
+        StreamDecoder stream(data, bitCount, out, symbolCount);
+        const unsigned safe = safeBits(table);
+        while (size_t steps = stream.fastSteps(safe))
         {
-            char ch = inFile.get();
-            size_t codeLength;
-            inFile.read(reinterpret_cast<char *>(&codeLength), sizeof(codeLength));
-            std::string code(codeLength, '\0');
-            inFile.read(&code[0], codeLength);
-            reverseHuffmanCodes[code] = ch;
+            for (; steps > 0; --steps)
+            {
+                stream.decodeFast(table);
+            }
         }
+        stream.decodeTail(table);
+    }
 
-        // Read encoded text length
-        size_t encodedSize;
-        inFile.read(reinterpret_cast<char *>(&encodedSize), sizeof(encodedSize));
+    // Split a buffer into STREAM_COUNT contiguous segments
+    size_t segmentSize(size_t total, size_t index)
+    {
+        const size_t segment = (total + STREAM_COUNT - 1) / STREAM_COUNT;
+        const size_t start = std::min(total, segment * index);
+        return std::min(segment, total - start);
+    }
 
-        // Read encoded text
-        std::string encodedText;
-        for (size_t i = 0; i < encodedSize; i += 8)
+    // Decode the interleaved streams round-robin so their decode chains overlap
+    void decodeStreams(const DecodeTable &table, const std::array<const uint8_t *, STREAM_COUNT> &data,
+                       const std::array<size_t, STREAM_COUNT> &bitCounts, char *out, size_t symbolCount)
+    {
+        std::array<StreamDecoder, STREAM_COUNT> streams;
+        for (size_t i = 0; i < STREAM_COUNT; ++i)
         {
-            char byte;
-            inFile.get(byte);
-            encodedText += std::bitset<8>(byte).to_string();
+            streams[i] = StreamDecoder(data[i], bitCounts[i], out, segmentSize(symbolCount, i));
+            out += segmentSize(symbolCount, i);
         }
 
-        // Decode the text
-        std::string currentCode;
-        std::string decompressedText;
-        for (char bit : encodedText)
+        const unsigned safe = safeBits(table);
+        for (;;)
         {
-            currentCode += bit;
-            if (reverseHuffmanCodes.count(currentCode))
+            size_t steps = streams[0].fastSteps(safe);
+            for (size_t i = 1; i < STREAM_COUNT; ++i)
             {
-                decompressedText += reverseHuffmanCodes[currentCode];
-                currentCode.clear();
+                steps = std::min(steps, streams[i].fastSteps(safe));
+            }
+            if (steps == 0)
+            {
+                break;
+            }
+            for (; steps > 0; --steps)
+            {
+                streams[0].decodeFast(table);
+                streams[1].decodeFast(table);
+                streams[2].decodeFast(table);
+                streams[3].decodeFast(table);
             }
         }
 
-        // Write decompressed text to the output file
-        std::ofstream outFile(outputFile, std::ios::binary);
-        if (!outFile)
+        for (StreamDecoder &stream : streams)
         {
-            throw std::runtime_error("Failed to open output file: " + outputFile);
+            while (size_t steps = stream.fastSteps(safe))
+            {
+                for (; steps > 0; --steps)
+                {
+                    stream.decodeFast(table);
+                }
+            }
+            stream.decodeTail(table);
         }
-        outFile << decompressedText;
-        outFile.close();
     }
 
-    // Compress a folder
-    void compressFolder(const std::string &inputFolder, const std::string &outputFile)
+    namespace
     {
-        if (!fs::exists(inputFolder))
+        // Set in the first byte of a compressed file when the payload is a sequence of blocks
+        constexpr uint8_t BLOCKED_FLAG = 0x80;
+
+        // Set in the first byte when the blocks are coded with a trained table whose id follows the byte
+        constexpr uint8_t SHARED_TABLE_FLAG = 0x40;
+
+        // First bytes of a trained table file
+        constexpr std::array<char, 8> TABLE_MAGIC = {'C', 'O', 'D', 'E', 'H', 'U', 'F', '1'};
+
+        // Trained table ids are the FNV-1a hash of the code lengths
+        uint32_t tableId(const CodeLengths &lengths)
         {
-            throw std::runtime_error("Input folder does not exist: " + inputFolder);
+            uint32_t hash = 2166136261u;
+            for (uint8_t length : lengths)
+            {
+                hash = (hash ^ length) * 16777619u;
+            }
+            return hash;
         }
 
-        // Append .folder.lzw extension if not already present
-        std::string finalOutputFile = outputFile;
-        if (fs::path(finalOutputFile).extension() != ".folder.huff")
+        std::string formatTableId(uint32_t id)
         {
-            finalOutputFile += ".folder.huff";
+            std::ostringstream text;
+            text << std::hex << std::setw(8) << std::setfill('0') << id;
+            return text.str();
         }
 
-        std::ofstream outFile(finalOutputFile, std::ios::binary);
-        if (!outFile)
+        // First byte of an image, and the trained table id that follows it when there is one
+        struct ImageHeader
+        {
+            Layout layout = Layout::SingleStream;
+            bool blocked = false;
+            bool shared = false;
+            uint32_t tableId = 0;
+        };
+
+        void writeHeader(std::ostream &out, const CompressOptions &options, bool blocked)
         {
-            throw std::runtime_error("Failed to open output file: " + finalOutputFile);
+            uint8_t header = static_cast<uint8_t>(options.layout);
+            if (blocked)
+            {
+                header |= BLOCKED_FLAG;
+            }
+            if (options.table != nullptr)
+            {
+                header |= SHARED_TABLE_FLAG;
+            }
+            out.put(static_cast<char>(header));
+            if (options.table != nullptr)
+            {
+                out.write(reinterpret_cast<const char *>(&options.table->id), sizeof(options.table->id));
+            }
         }
 
-        // Collect all files including those in subfolders
-        std::vector<fs::path> files;
-        for (const auto &entry : fs::recursive_directory_iterator(inputFolder))
+        ImageHeader readHeader(std::istream &in)
         {
-            if (entry.is_regular_file())
+            const int header = in.get();
+            if (header == std::char_traits<char>::eof())
+            {
+                throw std::runtime_error("Truncated compressed data");
+            }
+            ImageHeader image;
+            image.blocked = (header & BLOCKED_FLAG) != 0;
+            image.shared = (header & SHARED_TABLE_FLAG) != 0;
+            image.layout = static_cast<Layout>(header & ~(BLOCKED_FLAG | SHARED_TABLE_FLAG));
+            if (image.layout != Layout::SingleStream && image.layout != Layout::FourStreams)
+            {
+                throw std::runtime_error("Unknown Huffman layout");
+            }
+            if (image.shared && !in.read(reinterpret_cast<char *>(&image.tableId), sizeof(image.tableId)))
             {
-                files.push_back(entry.path());
+                throw std::runtime_error("Truncated compressed data");
             }
+            return image;
         }
 
-        // Write file count
-        const size_t fileCount = files.size();
-        outFile.write(reinterpret_cast<const char *>(&fileCount), sizeof(fileCount));
+        // The trained table an image was coded with, or nullptr when its blocks carry their own code lengths
+        const TrainedTable *imageTable(const ImageHeader &image, const TrainedTable *table)
+        {
+            if (!image.shared)
+            {
+                return nullptr;
+            }
+            if (table == nullptr || table->id != image.tableId)
+            {
+                throw std::runtime_error("Compressed data needs trained Huffman table " + formatTableId(image.tableId));
+            }
+            return table;
+        }
 
-        constexpr size_t BUFFER_SIZE = 8192; // 8KB buffer
-        std::vector<char> readBuffer(BUFFER_SIZE);
+        // Read the bit count of every stream. Each symbol takes between 1 and MAX_CODE_LENGTH bits, so the counts
+        // bound the packed size by the symbol counts and the symbol counts by the packed data actually present.
+        // Returns the packed size of all streams in bytes.
+        size_t readBitCounts(std::istream &in, Layout layout, size_t originalSize, std::array<size_t, STREAM_COUNT> &bitCounts)
+        {
+            const size_t streamCount = layout == Layout::FourStreams ? STREAM_COUNT : 1;
+            if (!in.read(reinterpret_cast<char *>(bitCounts.data()), static_cast<std::streamsize>(streamCount * sizeof(size_t))))
+            {
+                throw std::runtime_error("Truncated Huffman block");
+            }
+            if (originalSize > std::numeric_limits<size_t>::max() / MAX_CODE_LENGTH)
+            {
+                throw std::runtime_error("Invalid Huffman block size");
+            }
 
-        // Get base path for relative path calculation
-        const fs::path basePath = fs::canonical(inputFolder);
+            size_t packedSize = 0;
+            for (size_t i = 0; i < streamCount; ++i)
+            {
+                const size_t symbols = streamCount == 1 ? originalSize : segmentSize(originalSize, i);
+                if (bitCounts[i] < symbols || bitCounts[i] > symbols * MAX_CODE_LENGTH)
+                {
+                    throw std::runtime_error("Invalid Huffman bit count");
+                }
+                packedSize += bitCounts[i] / 8 + (bitCounts[i] % 8 != 0 ? 1 : 0);
+            }
+            return packedSize;
+        }
 
-        for (const auto &filePath : files)
+        // Read count bytes into buffer at offset, growing it only as the bytes arrive, so a corrupt size in the
+        // header fails as truncated data instead of allocating memory for bytes that are not there
+        template <typename Buffer>
+        void readPacked(std::istream &in, Buffer &buffer, size_t offset, size_t count)
         {
-            const std::string tempCompressedFile = fs::temp_directory_path() / (std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".lzw");
+            constexpr size_t STEP = size_t{1} << 24;
+            size_t done = 0;
+            while (done < count)
+            {
+                const size_t piece = std::min(STEP, count - done);
+                buffer.resize(offset + done + piece);
+                in.read(reinterpret_cast<char *>(buffer.data()) + offset + done, static_cast<std::streamsize>(piece));
+                if (static_cast<size_t>(in.gcount()) != piece)
+                {
+                    throw std::runtime_error("Truncated Huffman block");
+                }
+                done += piece;
+            }
+            buffer.resize(offset + count);
+        }
 
-            try
+        // Copy the next block of a blocked stream into raw without decoding it; false at the end marker
+        bool readRawBlock(std::istream &in, Layout layout, bool sharedLengths, std::string &raw)
+        {
+            size_t originalSize;
+            if (!in.read(reinterpret_cast<char *>(&originalSize), sizeof(originalSize)))
+            {
+                throw std::runtime_error("Truncated compressed data");
+            }
+            if (originalSize == 0)
+            {
+                return false;
+            }
+            if (originalSize > MAX_BLOCK_SIZE)
             {
-                // Calculate relative path from input folder
-                fs::path relativePath = fs::canonical(filePath).lexically_relative(basePath);
-                const std::string relativePathStr = relativePath.string();
+                throw std::runtime_error("Invalid Huffman block size");
+            }
 
-                // Compress the file
-                compress(filePath.string(), tempCompressedFile);
+            // The code lengths and bit counts give the size of the packed data
+            std::ostringstream copy;
+            copy.write(reinterpret_cast<const char *>(&originalSize), sizeof(originalSize));
+            if (!sharedLengths)
+            {
+                writeCodeLengths(copy, readCodeLengths(in));
+            }
+            std::array<size_t, STREAM_COUNT> bitCounts{};
+            const size_t packedSize = readBitCounts(in, layout, originalSize, bitCounts);
+            const size_t streamCount = layout == Layout::FourStreams ? STREAM_COUNT : 1;
+            copy.write(reinterpret_cast<const char *>(bitCounts.data()), static_cast<std::streamsize>(streamCount * sizeof(size_t)));
 
-                // Read compressed file efficiently
-                std::ifstream tempFile(tempCompressedFile, std::ios::binary | std::ios::ate);
-                if (!tempFile)
-                {
-                    throw std::runtime_error("Failed to open temp compressed file: " + tempCompressedFile);
-                }
+            raw = std::move(copy).str();
+            readPacked(in, raw, raw.size(), packedSize);
+            return true;
+        }
 
-                const size_t dataSize = tempFile.tellg();
-                tempFile.seekg(0);
+        // Reject option values the format cannot represent
+        void checkOptions(const CompressOptions &options)
+        {
+            checkCodeLengthLimit(options.maxCodeLength);
+            if (options.blockSize != 0 && (options.blockSize < MIN_BLOCK_SIZE || options.blockSize > MAX_BLOCK_SIZE))
+            {
+                throw std::invalid_argument("Huffman block size must be between " + std::to_string(MIN_BLOCK_SIZE) + " and " +
+                                            std::to_string(MAX_BLOCK_SIZE) + " bytes");
+            }
+            // A symbol without a code would silently vanish from the output
+            if (options.table != nullptr &&
+                std::find(options.table->lengths.begin(), options.table->lengths.end(), 0) != options.table->lengths.end())
+            {
+                throw std::invalid_argument("Trained Huffman table must have a code for every byte");
+            }
+        }
 
-                // Write relative path length and path
-                const size_t pathLength = relativePathStr.size();
-                outFile.write(reinterpret_cast<const char *>(&pathLength), sizeof(pathLength));
-                outFile.write(relativePathStr.c_str(), pathLength);
+        // Contexts keep scratch buffers up to this size between calls; larger ones are released after use
+        constexpr size_t MAX_RETAINED_BYTES = size_t{1} << 20;
 
-                // Write data size and content
-                outFile.write(reinterpret_cast<const char *>(&dataSize), sizeof(dataSize));
+        template <typename Buffer>
+        void releaseIfLarge(Buffer &buffer)
+        {
+            if (buffer.capacity() > MAX_RETAINED_BYTES)
+            {
+                Buffer().swap(buffer);
+            }
+        }
 
-                while (tempFile)
-                {
-                    tempFile.read(readBuffer.data(), BUFFER_SIZE);
-                    outFile.write(readBuffer.data(), tempFile.gcount());
-                }
+        // The free functions code on one context per thread
+        CompressContext &threadCompressContext()
+        {
+            static thread_local CompressContext context;
+            return context;
+        }
+
+        DecompressContext &threadDecompressContext()
+        {
+            static thread_local DecompressContext context;
+            return context;
+        }
+    } // namespace
+
+    CompressContext::CompressContext(const CompressOptions &options) : settings(options)
+    {
+        checkOptions(options);
+    }
+
+    // Encode one block: original size, code lengths, bit count(s), packed stream(s)
+    void CompressContext::writeBlock(std::ostream &out, const uint8_t *data, size_t size, const CompressOptions &options)
+    {
+        // Code with the trained table if there is one, else build code lengths with this context's builder
+        CodeLengths lengths;
+        if (options.table != nullptr)
+        {
+            lengths = options.table->lengths;
+        }
+        else
+        {
+            lengths = builder.build(data, size);
+            limitCodeLengths(lengths, options.maxCodeLength);
+        }
+        const CodeTable codeTable = canonicalCodes(lengths);
+
+        out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        if (options.table == nullptr)
+        {
+            writeCodeLengths(out, lengths);
+        }
 
-                tempFile.close();
-                fs::remove(tempCompressedFile);
+        if (options.layout == Layout::FourStreams)
+        {
+            // Encode each segment independently, then write the jump table and the streams
+            std::array<size_t, STREAM_COUNT> bitCounts{};
+            size_t offset = 0;
+            for (size_t i = 0; i < STREAM_COUNT; ++i)
+            {
+                const size_t segment = segmentSize(size, i);
+                bitCounts[i] = encode(data + offset, segment, codeTable, packed[i]);
+                offset += segment;
             }
-            catch (const std::exception &e)
+            out.write(reinterpret_cast<const char *>(bitCounts.data()), sizeof(bitCounts));
+            for (auto &stream : packed)
             {
-                if (fs::exists(tempCompressedFile))
-                {
-                    fs::remove(tempCompressedFile);
-                }
-                throw std::runtime_error("Error processing file " + filePath.string() + ": " + e.what());
+                out.write(reinterpret_cast<const char *>(stream.data()), stream.size());
+                releaseIfLarge(stream);
             }
         }
+        else
+        {
+            // Write encoded bit count and packed bits
+            const size_t encodedSize = encode(data, size, codeTable, packed[0]);
+            out.write(reinterpret_cast<const char *>(&encodedSize), sizeof(encodedSize));
+            out.write(reinterpret_cast<const char *>(packed[0].data()), packed[0].size());
+            releaseIfLarge(packed[0]);
+        }
     }
 
-    // Decompress a folder
-    void decompressFolder(const std::string &inputFile, const std::string &outputFolder)
+    // Same image as compressBytes, with every block coded here on the calling thread
+    void CompressContext::compressTo(const uint8_t *data, size_t size, std::ostream &out)
     {
-        if (!fs::exists(inputFile))
+        if (settings.blockSize == 0)
         {
-            throw std::runtime_error("Input file does not exist: " + inputFile);
+            writeHeader(out, settings, false);
+            writeBlock(out, data, size, settings);
+            return;
         }
 
-        std::ifstream inFile(inputFile, std::ios::binary);
-        if (!inFile)
+        writeHeader(out, settings, true);
+        for (size_t offset = 0; offset < size; offset += settings.blockSize)
+        {
+            writeBlock(out, data + offset, std::min(settings.blockSize, size - offset), settings);
+        }
+        const size_t endMarker = 0;
+        out.write(reinterpret_cast<const char *>(&endMarker), sizeof(endMarker));
+    }
+
+    std::vector<std::byte> CompressContext::compress(std::span<const std::byte> input)
+    {
+        std::vector<std::byte> compressed;
+        io::VectorBuffer buffer(compressed);
+        std::ostream out(&buffer);
+        compressTo(reinterpret_cast<const uint8_t *>(input.data()), input.size(), out);
+        return compressed;
+    }
+
+    size_t CompressContext::compress(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream out(&buffer);
+        compressTo(reinterpret_cast<const uint8_t *>(input.data()), input.size(), out);
+        if (!out)
+        {
+            throw std::invalid_argument("Output buffer too small for the compressed data");
+        }
+        return buffer.written();
+    }
+
+    // Decode the rest of a block whose original size has already been read
+    void DecompressContext::readBlock(std::istream &in, Layout layout, size_t originalSize, std::string &text, const TrainedTable *shared)
+    {
+        const CodeLengths lengths = shared != nullptr ? shared->lengths : readCodeLengths(in);
+
+        // Read the bit count of every stream, then the packed bits of all streams back to back. The packed
+        // data is read before the output is sized, and the bit counts bound originalSize by its length.
+        std::array<size_t, STREAM_COUNT> bitCounts{};
+        const size_t packedSize = readBitCounts(in, layout, originalSize, bitCounts);
+        std::array<size_t, STREAM_COUNT> offsets{};
+        for (size_t i = 1; i < STREAM_COUNT; ++i)
         {
-            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+            offsets[i] = offsets[i - 1] + (bitCounts[i - 1] + 7) / 8;
         }
+        readPacked(in, packed, 0, packedSize);
 
-        // Remove output folder if it exists and create it fresh
-        if (fs::exists(outputFolder))
+        // Rebuild the decode table unless the previous block used the same code lengths
+        if (!haveTable || lengths != tableLengths)
         {
-            fs::remove_all(outputFolder);
+            haveTable = false;
+            buildDecodeTable(lengths, table);
+            tableLengths = lengths;
+            haveTable = true;
         }
 
-        // Create fresh output directory
-        if (!fs::create_directory(outputFolder))
+        // Decode the text
+        text.resize(originalSize);
+        if (layout == Layout::FourStreams)
+        {
+            std::array<const uint8_t *, STREAM_COUNT> streams{};
+            for (size_t i = 0; i < STREAM_COUNT; ++i)
+            {
+                streams[i] = packed.data() + offsets[i];
+            }
+            decodeStreams(table, streams, bitCounts, text.data(), originalSize);
+        }
+        else
         {
-            throw std::runtime_error("Failed to create output directory: " + outputFolder);
+            decodeBits(table, packed.data(), bitCounts[0], text.data(), originalSize);
+        }
+        releaseIfLarge(packed);
+    }
+
+    // Same as decompressStream, with every block decoded here on the calling thread
+    void DecompressContext::decompressTo(std::istream &in, std::ostream &out)
+    {
+        const ImageHeader image = readHeader(in);
+        const TrainedTable *shared = imageTable(image, sharedTable);
+        while (true)
+        {
+            size_t originalSize;
+            if (!in.read(reinterpret_cast<char *>(&originalSize), sizeof(originalSize)))
+            {
+                throw std::runtime_error("Truncated compressed data");
+            }
+            if (image.blocked && originalSize == 0)
+            {
+                break;
+            }
+            if (image.blocked && originalSize > MAX_BLOCK_SIZE)
+            {
+                throw std::runtime_error("Invalid Huffman block size");
+            }
+            readBlock(in, image.layout, originalSize, decoded, shared);
+            out.write(decoded.data(), static_cast<std::streamsize>(decoded.size()));
+            releaseIfLarge(decoded);
+            if (!image.blocked)
+            {
+                break;
+            }
         }
+    }
+
+    std::vector<std::byte> DecompressContext::decompress(std::span<const std::byte> input)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream in(&source);
+        std::vector<std::byte> decompressed;
+        io::VectorBuffer buffer(decompressed);
+        std::ostream out(&buffer);
+        decompressTo(in, out);
+        return decompressed;
+    }
 
-        size_t fileCount;
-        inFile.read(reinterpret_cast<char *>(&fileCount), sizeof(fileCount));
+    size_t DecompressContext::decompress(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream in(&source);
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream out(&buffer);
+        decompressTo(in, out);
+        if (!out)
+        {
+            throw std::invalid_argument("Output buffer too small for the decompressed data");
+        }
+        return buffer.written();
+    }
 
-        constexpr size_t BUFFER_SIZE = 8192; // 8KB buffer
-        std::vector<char> buffer(BUFFER_SIZE);
+    // Compress a stream
+    void compressStream(std::istream &in, std::ostream &out, const CompressOptions &options)
+    {
+        checkOptions(options);
 
-        for (size_t i = 0; i < fileCount; ++i)
+        if (options.blockSize == 0)
         {
-            // Read relative path
-            size_t pathLength;
-            inFile.read(reinterpret_cast<char *>(&pathLength), sizeof(pathLength));
-            std::string relativePath(pathLength, '\0');
-            inFile.read(&relativePath[0], pathLength);
+            // Read the whole input and code it as a single block
+            std::ostringstream buffer;
+            buffer << in.rdbuf();
+            const std::string inputText = std::move(buffer).str();
+            compressBytes(reinterpret_cast<const uint8_t *>(inputText.data()), inputText.size(), out, options);
+            return;
+        }
 
-            // Read file size
-            size_t dataSize;
-            inFile.read(reinterpret_cast<char *>(&dataSize), sizeof(dataSize));
+        // Stream fixed-size blocks, each with its own code table, then an empty end block. Blocks are
+        // independent, so they are coded on options.threads workers and written back in order.
+        writeHeader(out, options, true);
+        parallel::orderedPipeline(
+            options.threads,
+            [&](size_t, std::string &block)
+            {
+                block.resize(options.blockSize);
+                in.read(block.data(), static_cast<std::streamsize>(block.size()));
+                block.resize(static_cast<size_t>(in.gcount()));
+                return !block.empty();
+            },
+            [&](size_t, unsigned, std::string &block)
+            {
+                std::ostringstream coded;
+                threadCompressContext().writeBlock(coded, reinterpret_cast<const uint8_t *>(block.data()), block.size(), options);
+                return std::move(coded).str();
+            },
+            [&](size_t, std::string &coded)
+            {
+                out.write(coded.data(), static_cast<std::streamsize>(coded.size()));
+            });
+        const size_t endMarker = 0;
+        out.write(reinterpret_cast<const char *>(&endMarker), sizeof(endMarker));
+    }
+
+    // Compress a buffer
+    void compressBytes(const uint8_t *data, size_t size, std::ostream &out, const CompressOptions &options)
+    {
+        checkOptions(options);
 
-            // Create temporary file
-            const std::string tempCompressedFile = fs::temp_directory_path() / (std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".huff");
+        if (options.blockSize == 0)
+        {
+            writeHeader(out, options, false);
+            threadCompressContext().writeBlock(out, data, size, options);
+            return;
+        }
 
-            try
+        // Code the blocks straight from the buffer on the workers, then write them in order
+        writeHeader(out, options, true);
+        const size_t blockCount = (size + options.blockSize - 1) / options.blockSize;
+        parallel::orderedMap(
+            blockCount, options.threads,
+            [&](size_t index)
+            {
+                const size_t offset = index * options.blockSize;
+                std::ostringstream coded;
+                threadCompressContext().writeBlock(coded, data + offset, std::min(options.blockSize, size - offset), options);
+                return std::move(coded).str();
+            },
+            [&](size_t, std::string &coded)
             {
-                // Construct full output path
-                fs::path fullOutputPath = fs::path(outputFolder) / relativePath;
+                out.write(coded.data(), static_cast<std::streamsize>(coded.size()));
+            });
+        const size_t endMarker = 0;
+        out.write(reinterpret_cast<const char *>(&endMarker), sizeof(endMarker));
+    }
 
-                // Create parent directories if they don't exist
-                fs::create_directories(fullOutputPath.parent_path());
+    // Every byte gets a code, so the table can code any input and not only bytes seen in the samples
+    TrainedTable trainTable(const Histogram &frequency, unsigned maxCodeLength)
+    {
+        Histogram counts = frequency;
+        for (uint64_t &count : counts)
+        {
+            ++count;
+        }
 
-                // Write compressed data to temporary file
-                std::ofstream tempFile(tempCompressedFile, std::ios::binary);
-                if (!tempFile)
-                {
-                    throw std::runtime_error("Failed to create temporary file: " + tempCompressedFile);
-                }
+        TreeBuilder builder;
+        TrainedTable table;
+        table.lengths = builder.build(counts);
+        limitCodeLengths(table.lengths, maxCodeLength);
+        table.id = tableId(table.lengths);
+        return table;
+    }
 
-                // Copy data in chunks
-                size_t remainingBytes = dataSize;
-                while (remainingBytes > 0)
+    // Count the bytes of one sample file, or of every regular file under a sample folder
+    TrainedTable trainTable(const std::string &samplePath, unsigned maxCodeLength)
+    {
+        std::vector<std::string> samples;
+        if (fs::is_directory(samplePath))
+        {
+            for (const auto &entry : fs::recursive_directory_iterator(samplePath))
+            {
+                if (entry.is_regular_file())
                 {
-                    const size_t bytesToRead = std::min(BUFFER_SIZE, remainingBytes);
-                    inFile.read(buffer.data(), bytesToRead);
-                    tempFile.write(buffer.data(), bytesToRead);
-                    remainingBytes -= bytesToRead;
+                    samples.push_back(entry.path().string());
                 }
-                tempFile.close();
+            }
+            std::sort(samples.begin(), samples.end());
+        }
+        else
+        {
+            samples.push_back(samplePath);
+        }
 
-                // Decompress to final destination
-                decompress(tempCompressedFile, fullOutputPath.string());
+        Histogram counts{};
+        for (const std::string &sample : samples)
+        {
+            const io::MappedFile input(sample);
+            if (input.mapped())
+            {
+                histogram::count(input.data(), input.size(), counts);
+                continue;
+            }
 
-                // Cleanup
-                fs::remove(tempCompressedFile);
+            std::ifstream inFile(sample, std::ios::binary);
+            if (!inFile)
+            {
+                throw std::runtime_error("Failed to open input file: " + sample);
             }
-            catch (const std::exception &e)
+            std::vector<uint8_t> buffer(io::BUFFER_SIZE);
+            while (inFile.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size())) || inFile.gcount() > 0)
             {
-                if (fs::exists(tempCompressedFile))
-                {
-                    fs::remove(tempCompressedFile);
-                }
-                throw std::runtime_error("Error processing file " + relativePath + ": " + e.what());
+                histogram::count(buffer.data(), static_cast<size_t>(inFile.gcount()), counts);
+            }
+        }
+        return trainTable(counts, maxCodeLength);
+    }
+
+    void saveTable(const TrainedTable &table, const std::string &path)
+    {
+        io::OutputFile output(path);
+        std::ostream &out = output.stream();
+        out.write(TABLE_MAGIC.data(), TABLE_MAGIC.size());
+        out.write(reinterpret_cast<const char *>(&table.id), sizeof(table.id));
+        writeCodeLengths(out, table.lengths);
+        output.close();
+    }
+
+    // The id is recomputed from the lengths, so a damaged file is rejected here rather than decoding garbage
+    TrainedTable loadTable(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error("Failed to open table file: " + path);
+        }
+
+        std::array<char, TABLE_MAGIC.size()> magic{};
+        TrainedTable table;
+        try
+        {
+            if (!in.read(magic.data(), magic.size()) || magic != TABLE_MAGIC ||
+                !in.read(reinterpret_cast<char *>(&table.id), sizeof(table.id)))
+            {
+                throw std::runtime_error("Invalid Huffman table file");
             }
+            table.lengths = readCodeLengths(in);
+            DecodeTable decodeTable;
+            buildDecodeTable(table.lengths, decodeTable);
+        }
+        catch (const std::runtime_error &)
+        {
+            throw std::runtime_error("Invalid Huffman table file: " + path);
+        }
+        if (table.id != tableId(table.lengths) ||
+            std::find(table.lengths.begin(), table.lengths.end(), 0) != table.lengths.end())
+        {
+            throw std::runtime_error("Invalid Huffman table file: " + path);
+        }
+        return table;
+    }
+
+    // Worst case: every block stores a full length table and every byte takes a longest code
+    size_t maxCompressedSize(size_t size, const CompressOptions &options)
+    {
+        checkOptions(options);
+
+        const size_t blockCount = options.blockSize == 0 ? 1 : (size + options.blockSize - 1) / options.blockSize;
+        const size_t blockHeader = sizeof(size_t) + 2 * SYMBOL_COUNT + STREAM_COUNT * (sizeof(size_t) + 1);
+        const size_t endMarker = options.blockSize == 0 ? 0 : sizeof(size_t);
+        size_t header = 1;
+        size_t longest = options.maxCodeLength;
+        if (options.table != nullptr)
+        {
+            header += sizeof(options.table->id);
+            longest = *std::max_element(options.table->lengths.begin(), options.table->lengths.end());
+        }
+        return header + blockCount * blockHeader + (size * longest + 7) / 8 + endMarker;
+    }
+
+    // Compress a buffer into a growing vector
+    std::vector<std::byte> compressBuffer(std::span<const std::byte> input, const CompressOptions &options)
+    {
+        std::vector<std::byte> compressed;
+        io::VectorBuffer buffer(compressed);
+        std::ostream out(&buffer);
+        compressBytes(reinterpret_cast<const uint8_t *>(input.data()), input.size(), out, options);
+        return compressed;
+    }
+
+    // Compress a buffer into caller memory; the stream fails once the output range is full
+    size_t compressBuffer(std::span<const std::byte> input, std::span<std::byte> output, const CompressOptions &options)
+    {
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream out(&buffer);
+        compressBytes(reinterpret_cast<const uint8_t *>(input.data()), input.size(), out, options);
+        if (!out)
+        {
+            throw std::invalid_argument("Output buffer too small for the compressed data");
+        }
+        return buffer.written();
+    }
+
+    // Compress a file into a stream, straight from a memory mapping when the file can be mapped
+    void compressFile(const std::string &inputFile, std::ostream &out, const CompressOptions &options)
+    {
+        const io::MappedFile input(inputFile);
+        if (input.mapped())
+        {
+            compressBytes(input.data(), input.size(), out, options);
+            return;
+        }
+
+        std::ifstream inFile(inputFile, std::ios::binary);
+        if (!inFile)
+        {
+            throw std::runtime_error("Failed to open input file: " + inputFile);
         }
+        compressStream(inFile, out, options);
+    }
+
+    // Compress a single file
+    void compress(const std::string &inputFile, const std::string &outputFile, const CompressOptions &options)
+    {
+        checkOptions(options);
+
+        io::OutputFile output(outputFile);
+        compressFile(inputFile, output.stream(), options);
+        output.close();
+    }
+
+    // Decompress a stream
+    void decompressStream(std::istream &in, std::ostream &out, unsigned threads, const TrainedTable *table)
+    {
+        // Read the header and check the trained table against it
+        const ImageHeader image = readHeader(in);
+        const TrainedTable *shared = imageTable(image, table);
+        const Layout layout = image.layout;
+
+        if (!image.blocked)
+        {
+            size_t originalSize;
+            if (!in.read(reinterpret_cast<char *>(&originalSize), sizeof(originalSize)))
+            {
+                throw std::runtime_error("Truncated compressed data");
+            }
+            std::string decompressedText;
+            threadDecompressContext().readBlock(in, layout, originalSize, decompressedText, shared);
+            out.write(decompressedText.data(), decompressedText.size());
+            return;
+        }
+
+        // Split the stream into blocks on this thread and decode them on the workers; only the blocks in
+        // flight are held in memory
+        parallel::orderedPipeline(
+            threads,
+            [&](size_t, std::string &block)
+            {
+                return readRawBlock(in, layout, shared != nullptr, block);
+            },
+            [&](size_t, unsigned, std::string &block)
+            {
+                std::istringstream blockStream(std::move(block));
+                size_t originalSize;
+                blockStream.read(reinterpret_cast<char *>(&originalSize), sizeof(originalSize));
+                std::string decompressedText;
+                threadDecompressContext().readBlock(blockStream, layout, originalSize, decompressedText, shared);
+                return decompressedText;
+            },
+            [&](size_t, std::string &decompressedText)
+            {
+                out.write(decompressedText.data(), static_cast<std::streamsize>(decompressedText.size()));
+            });
+    }
+
+    // Decompress a buffer into a growing vector
+    std::vector<std::byte> decompressBuffer(std::span<const std::byte> input, unsigned threads, const TrainedTable *table)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream in(&source);
+        std::vector<std::byte> decompressed;
+        io::VectorBuffer buffer(decompressed);
+        std::ostream out(&buffer);
+        decompressStream(in, out, threads, table);
+        return decompressed;
+    }
+
+    // Decompress a buffer into caller memory
+    size_t decompressBuffer(std::span<const std::byte> input, std::span<std::byte> output, unsigned threads, const TrainedTable *table)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream in(&source);
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream out(&buffer);
+        decompressStream(in, out, threads, table);
+        if (!out)
+        {
+            throw std::invalid_argument("Output buffer too small for the decompressed data");
+        }
+        return buffer.written();
+    }
+
+    // Decompress a single file
+    void decompress(const std::string &inputFile, const std::string &outputFile, unsigned threads, const TrainedTable *table)
+    {
+        // Read the compressed data from a memory mapping when possible
+        io::InputFile input(inputFile);
+        std::istream &inFile = input.stream();
+
+        io::OutputFile output(outputFile);
+
+        try
+        {
+            decompressStream(inFile, output.stream(), threads, table);
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(std::string(e.what()) + ": " + inputFile);
+        }
+        output.close();
+    }
+
+    // Compress a folder
+    void compressFolder(const std::string &inputFolder, const std::string &outputFile, const CompressOptions &options)
+    {
+        // Append .folder.huff extension if not already present
+        std::string finalOutputFile = outputFile;
+        if (fs::path(finalOutputFile).extension() != ".folder.huff")
+        {
+            finalOutputFile += ".folder.huff";
+        }
+
+        checkOptions(options);
+
+        // Files are already spread over the workers, so each one is coded on a single thread
+        CompressOptions fileOptions = options;
+        fileOptions.threads = 1;
+        archive::create(inputFolder, finalOutputFile, archive::Codec::Huffman, options.threads, [&fileOptions](const std::string &inputFile, std::ostream &out)
+                        { compressFile(inputFile, out, fileOptions); });
+    }
+
+    // Decompress a folder
+    void decompressFolder(const std::string &inputFile, const std::string &outputFolder, unsigned threads, const TrainedTable *table)
+    {
+        archive::extract(inputFile, outputFolder, archive::Codec::Huffman, threads, [table](std::istream &in, std::ostream &out, unsigned)
+                         { decompressStream(in, out, 1, table); });
     }
-} // namespace huffman
\ No newline at end of file
+} // namespace huffman
@@ -1,21 +1,314 @@
 #include "lzw.hpp"
+#include "archive.hpp"
+#include "parallel.hpp"
+#include "mapped_file.hpp"
+#include "bit_io.hpp"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
-#include <chrono>
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <unordered_map>
+#include <bit>
 
 namespace lzw
 {
+    namespace
+    {
+        /**
+         * @brief Open-addressing map from (prefix code, next byte) to the code of the extended sequence.
+         *
+         * Keys are packed as prefix << 8 | byte, so looking up the next sequence costs one integer hash and
+         * a short linear probe with no string building or allocation. Each slot also records the generation
+         * it was written in and only slots of the current generation count as occupied, so clear() starts a
+         * new generation instead of rewriting the whole table. Trained phrases are written with a generation
+         * above every other, so they stay occupied across clear().
+         */
+        class PhraseTable
+        {
+        public:
+            static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+            /**
+             * @brief Create a table for up to maxCodes entries, kept at most half full.
+             */
+            explicit PhraseTable(size_t maxCodes)
+            {
+                size_t capacity = 1;
+                unsigned bits = 0;
+                while (capacity < 2 * maxCodes)
+                {
+                    capacity <<= 1;
+                    ++bits;
+                }
+                shift = 32 - bits;
+                mask = capacity - 1;
+                slots.assign(capacity, Slot{});
+            }
+
+            /**
+             * @brief Find the code for (prefix, byte); on a miss, remember the free slot for insert().
+             */
+            inline uint32_t find(uint32_t prefix, uint8_t byte)
+            {
+                const uint32_t key = (prefix << 8) | byte;
+                size_t index = (key * 0x9E3779B1u) >> shift;
+                while ((slots[index].value >> CODE_BITS) >= generation)
+                {
+                    if (slots[index].key == key)
+                    {
+                        return slots[index].value & CODE_MASK;
+                    }
+                    index = (index + 1) & mask;
+                }
+                freeSlot = index;
+                return NOT_FOUND;
+            }
+
+            /**
+             * @brief Insert (prefix, byte) -> code into the slot found by the last missed find().
+             */
+            inline void insert(uint32_t prefix, uint8_t byte, uint32_t code)
+            {
+                slots[freeSlot] = Slot{(prefix << 8) | byte, (generation << CODE_BITS) | code};
+            }
+
+            /**
+             * @brief Insert (prefix, byte) -> code as a trained phrase, which clear() keeps.
+             */
+            void prime(uint32_t prefix, uint8_t byte, uint32_t code)
+            {
+                if (find(prefix, byte) == NOT_FOUND)
+                {
+                    slots[freeSlot] = Slot{(prefix << 8) | byte, (PRIMED_GENERATION << CODE_BITS) | code};
+                }
+            }
+
+            /**
+             * @brief Remove every entry but the trained phrases; the slots are only rewritten once every
+             * PRIMED_GENERATION - 1 calls.
+             */
+            void clear()
+            {
+                if (++generation == PRIMED_GENERATION)
+                {
+                    for (Slot &slot : slots)
+                    {
+                        if ((slot.value >> CODE_BITS) != PRIMED_GENERATION)
+                        {
+                            slot = Slot{};
+                        }
+                    }
+                    generation = 1;
+                }
+            }
+
+        private:
+            static constexpr unsigned CODE_BITS = LZW::MAX_CODE_BITS;              // Codes fit below the generation
+            static constexpr uint32_t CODE_MASK = (uint32_t{1} << CODE_BITS) - 1;
+            static constexpr uint32_t PRIMED_GENERATION = UINT32_MAX >> CODE_BITS; // Generation 0 marks never-used slots
+
+            struct Slot
+            {
+                uint32_t key = 0;
+                uint32_t value = 0; // generation << CODE_BITS | code
+            };
+
+            std::vector<Slot> slots;
+            size_t mask = 0;
+            unsigned shift = 32;
+            size_t freeSlot = 0;
+            uint32_t generation = 1;
+        };
+
+        constexpr unsigned MIN_CODE_WIDTH = 9; // Narrowest packed code; widths grow with the dictionary
+
+        /**
+         * @brief Width of the next code: just enough bits for every code below codeLimit, at least MIN_CODE_WIDTH.
+         */
+        inline unsigned codeWidth(uint32_t codeLimit)
+        {
+            return std::max<unsigned>(MIN_CODE_WIDTH, static_cast<unsigned>(std::bit_width(codeLimit - 1)));
+        }
+
+        /**
+         * @brief Decides when a full dictionary should be reset.
+         *
+         * Measures compression over windows of CHECK_INTERVAL input bytes while the dictionary is full. A CLEAR is
+         * requested when a window's ratio (input bytes per output bit) falls more than RESET_MARGIN below the best
+         * window since the last reset, or when codes average fewer than MIN_BYTES_PER_CODE input bytes. The second
+         * rule catches a dictionary built from data unlike the current input (for example after a random
+         * region), whose ratio never drops because it was poor from the start; resetting such a dictionary
+         * costs nothing since it is hardly matching anyway.
+         */
+        class RatioMonitor
+        {
+        public:
+            static constexpr size_t CHECK_INTERVAL = size_t{1} << 16;
+            static constexpr double RESET_MARGIN = 0.10;
+            static constexpr double MIN_BYTES_PER_CODE = 1.5;
+
+            inline void addOutput(unsigned bits)
+            {
+                windowBits += bits;
+                ++windowCodes;
+            }
+
+            /**
+             * @brief Called on every emitted code while the dictionary is full; inputPos is the current input offset.
+             */
+            inline bool shouldReset(size_t inputPos)
+            {
+                if (inputPos < windowStart + CHECK_INTERVAL)
+                {
+                    return false;
+                }
+                const double bytes = static_cast<double>(inputPos - windowStart);
+                const double ratio = bytes / static_cast<double>(std::max<size_t>(windowBits, 1));
+                const double bytesPerCode = bytes / static_cast<double>(std::max<size_t>(windowCodes, 1));
+                windowStart = inputPos;
+                windowBits = 0;
+                windowCodes = 0;
+                if (ratio < bestRatio * (1.0 - RESET_MARGIN) || bytesPerCode < MIN_BYTES_PER_CODE)
+                {
+                    bestRatio = 0.0;
+                    return true;
+                }
+                bestRatio = std::max(bestRatio, ratio);
+                return false;
+            }
+
+        private:
+            size_t windowStart = 0;
+            size_t windowBits = 0;
+            size_t windowCodes = 0;
+            double bestRatio = 0.0;
+        };
+
+        // First bytes of a trained dictionary file
+        constexpr std::array<char, 8> DICTIONARY_MAGIC = {'C', 'O', 'D', 'E', 'L', 'Z', 'W', '1'};
+
+        // Trained dictionary ids are the FNV-1a hash of the entries
+        uint32_t dictionaryId(const TrainedDictionary &dictionary)
+        {
+            uint32_t hash = 2166136261u;
+            const auto mix = [&hash](uint32_t value)
+            {
+                for (int shift = 0; shift < 32; shift += 8)
+                {
+                    hash = (hash ^ ((value >> shift) & 0xFF)) * 16777619u;
+                }
+            };
+            for (size_t i = 0; i < dictionary.prefixes.size(); ++i)
+            {
+                mix(dictionary.prefixes[i]);
+                mix(dictionary.bytes[i]);
+            }
+            return hash;
+        }
+
+        std::string formatDictionaryId(uint32_t id)
+        {
+            std::ostringstream text;
+            text << std::hex << std::setw(8) << std::setfill('0') << id;
+            return text.str();
+        }
+
+        // Codes in use once the trained phrases are entered
+        uint32_t primedCodeCount(const TrainedDictionary *dictionary)
+        {
+            return LZW::FIRST_CODE + (dictionary != nullptr ? static_cast<uint32_t>(dictionary->prefixes.size()) : 0);
+        }
+
+        void checkDictionaryFits(const TrainedDictionary *dictionary, unsigned codeBits)
+        {
+            if (dictionary != nullptr && dictionary->prefixes.size() > (size_t{1} << codeBits) - LZW::FIRST_CODE)
+            {
+                throw std::invalid_argument("Trained LZW dictionary needs more than " + std::to_string(codeBits) + " code bits");
+            }
+        }
+
+        // Write one block-mode record: the size of the coded block followed by its bytes (size 0 ends the stream)
+        void writeBlockRecord(std::ostream &output, const std::string &coded)
+        {
+            const size_t codedSize = coded.size();
+            output.write(reinterpret_cast<const char *>(&codedSize), sizeof(codedSize));
+            output.write(coded.data(), static_cast<std::streamsize>(codedSize));
+        }
+    } // namespace
 
     /**
-     * @brief Initializes the dictionary with the first 256 single-byte sequences.
+     * @brief Creates a compressor whose dictionary holds up to 2^maxCodeBits codes, archiving folders on threads workers.
      */
-    void LZW::initializeDictionary()
+    LZW::LZW(unsigned maxCodeBits, unsigned threads, size_t blockSize, const TrainedDictionary *dictionary)
+        : codeBits(maxCodeBits), threadCount(threads), blockBytes(blockSize), trained(dictionary)
     {
+        if (maxCodeBits < MIN_CODE_BITS || maxCodeBits > MAX_CODE_BITS)
+        {
+            throw std::invalid_argument("LZW dictionary size must be between " + std::to_string(MIN_CODE_BITS) + " and " +
+                                        std::to_string(MAX_CODE_BITS) + " bits");
+        }
+        if (blockSize != 0 && (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE))
+        {
+            throw std::invalid_argument("LZW block size must be between " + std::to_string(MIN_BLOCK_SIZE) + " and " +
+                                        std::to_string(MAX_BLOCK_SIZE) + " bytes");
+        }
+    }
+
+    /**
+     * @brief Sizes the decompression dictionary and sets the first 256 single-byte sequences, then the primed phrases.
+     *
+     * Decoding only writes entries from the first free code up, so primed phrases left by the previous stream are
+     * still intact and are only copied again when the dictionary changes.
+     */
+    void LZW::initializeDictionary(size_t dictionarySize, const TrainedDictionary *primed)
+    {
+        prefixCode.resize(dictionarySize);
+        lastByte.resize(dictionarySize);
+        firstByte.resize(dictionarySize);
+        length.resize(dictionarySize);
         for (size_t i = 0; i < INITIAL_DICT_SIZE; i++)
         {
-            dictionary[i].sequence = {static_cast<uint8_t>(i)};
-            dictionary[i].used = true;
+            prefixCode[i] = 0;
+            lastByte[i] = static_cast<uint8_t>(i);
+            firstByte[i] = static_cast<uint8_t>(i);
+            length[i] = 1;
+        }
+
+        if (primed != nullptr && primed != loaded)
+        {
+            for (size_t i = 0; i < primed->prefixes.size(); ++i)
+            {
+                const uint32_t code = FIRST_CODE + static_cast<uint32_t>(i);
+                const uint32_t prefix = primed->prefixes[i];
+                prefixCode[code] = prefix;
+                lastByte[code] = primed->bytes[i];
+                firstByte[code] = firstByte[prefix];
+                length[code] = length[prefix] + 1;
+            }
+        }
+        loaded = primed;
+    }
+
+    void LZW::writeHeader(std::ostream &output, unsigned codeBits, bool blocked, const TrainedDictionary *dictionary)
+    {
+        checkDictionaryFits(dictionary, codeBits);
+
+        int header = static_cast<int>(codeBits);
+        if (blocked)
+        {
+            header |= BLOCKED_FLAG;
+        }
+        if (dictionary != nullptr)
+        {
+            header |= PRIMED_FLAG;
+        }
+        output.put(static_cast<char>(header));
+        if (dictionary != nullptr)
+        {
+            output.write(reinterpret_cast<const char *>(&dictionary->id), sizeof(dictionary->id));
         }
     }
 
@@ -31,67 +324,296 @@ namespace lzw
      */
     void LZW::compress(const std::string &inputFile, const std::string &outputFile)
     {
-        std::ifstream input(inputFile, std::ios::binary);
-        std::ofstream output(outputFile, std::ios::binary);
+        io::OutputFile output(outputFile);
+        compressFile(inputFile, output.stream());
+        output.close();
+    }
+
+    /**
+     * @brief Compresses a file into a stream, straight from a memory mapping when the file can be mapped.
+     */
+    void LZW::compressFile(const std::string &inputFile, std::ostream &output) const
+    {
+        const io::MappedFile input(inputFile);
+        if (input.mapped())
+        {
+            compressBytes(input.data(), input.size(), output);
+            return;
+        }
 
-        if (!input || !output)
+        std::ifstream inFile(inputFile, std::ios::binary);
+        if (!inFile)
         {
             throw std::runtime_error("Error opening files");
         }
+        compressStream(inFile, output);
+    }
+
+    /**
+     * @brief Incremental coder: feed() the input in pieces of any size, then finish() to emit the last code and END_CODE.
+     */
+    class LZW::Encoder
+    {
+    public:
+        Encoder(unsigned codeBits, const TrainedDictionary *primed, std::ostream &output)
+            : dictionarySize(uint32_t{1} << codeBits), firstFree(primedCodeCount(primed)), dict(dictionarySize), writer(output)
+        {
+            if (primed != nullptr)
+            {
+                for (size_t i = 0; i < primed->prefixes.size(); ++i)
+                {
+                    dict.prime(primed->prefixes[i], primed->bytes[i], FIRST_CODE + static_cast<uint32_t>(i));
+                }
+            }
+        }
+
+        void feed(const uint8_t *data, size_t size)
+        {
+            size_t i = 0;
+            if (size > 0 && !haveCurrent)
+            {
+                current = data[i++];
+                haveCurrent = true;
+            }
+
+            // Process each byte of the piece
+            for (; i < size; ++i)
+            {
+                const uint8_t byte = data[i];
+                const uint32_t code = dict.find(current, byte); // Find current + byte in the dictionary
+
+                if (code != PhraseTable::NOT_FOUND)
+                {
+                    current = code; // Extend the current sequence
+                }
+                else
+                {
+                    emit(current); // Add the current sequence to the compressed data
+                    if (nextCode < dictionarySize)
+                    {
+                        dict.insert(current, byte, nextCode++); // Add the new sequence to the dictionary
+                    }
+                    else if (monitor.shouldReset(inputPos + i))
+                    {
+                        // The frozen dictionary no longer fits the data: start over
+                        emit(CLEAR_CODE);
+                        dict.clear();
+                        nextCode = firstFree;
+                    }
+                    current = byte; // Start a new sequence with the current byte
+                }
+            }
+            inputPos += size;
+        }
+
+        /**
+         * @brief Start a new code stream written to output, keeping the phrase table, its trained phrases and the code buffer.
+         */
+        void reset(std::ostream &output)
+        {
+            dict.clear();
+            writer.reset(output);
+            nextCode = firstFree;
+            monitor = RatioMonitor{};
+            haveCurrent = false;
+            current = 0;
+            inputPos = 0;
+        }
+
+        void finish()
+        {
+            if (haveCurrent)
+            {
+                emit(current); // Add the last sequence to the compressed data
+            }
+
+            // The decoder expects the code after a sequence to possibly define an entry, so size END the same way
+            writer.put(END_CODE, codeWidth(haveCurrent ? std::min(nextCode + 1, dictionarySize) : nextCode));
+            writer.flush();
+        }
 
-        initializeDictionary();
+    private:
+        const uint32_t dictionarySize;
+        const uint32_t firstFree;      // First code after the trained phrases
+        PhraseTable dict;              // Single bytes are implicit codes 0-255
+        io::StreamBitWriter writer;    // Packed variable-width codes
+        uint32_t nextCode = firstFree; // Next available code
+        RatioMonitor monitor;
+        bool haveCurrent = false; // False until the first input byte
+        uint32_t current = 0;     // Code of the current sequence, carried across pieces
+        size_t inputPos = 0;      // Offset of the next piece in the whole input
 
-        // Read input file into a buffer
-        input.seekg(0, std::ios::end);                                 // Move to the end of the file
-        size_t fileSize = input.tellg();                               // Get the file size
-        input.seekg(0);                                                // Move back to the beginning of the file
-        std::vector<uint8_t> buffer(fileSize);                         // Create a buffer to hold the file contents
-        input.read(reinterpret_cast<char *>(buffer.data()), fileSize); // Read the file into the buffer
+        void emit(uint32_t code)
+        {
+            const unsigned width = codeWidth(nextCode);
+            writer.put(code, width);
+            monitor.addOutput(width);
+        }
+    };
+
+    /**
+     * @brief Reuses the thread's encoder when its settings match. Dictionaries are compared by id, a hash of their
+     * phrases, so the primed phrase table is kept for any object holding the same dictionary.
+     */
+    LZW::Encoder &LZW::threadEncoder(unsigned codeBits, const TrainedDictionary *dictionary, std::ostream &output)
+    {
+        struct Cached
+        {
+            std::unique_ptr<Encoder> encoder;
+            unsigned codeBits = 0;
+            bool primed = false;
+            uint32_t id = 0;
+        };
+        thread_local Cached cached;
 
-        // Initialize compression dictionary
-        std::unordered_map<std::string, uint16_t> dict; // Dictionary to store sequences
-        dict.reserve(DICTIONARY_SIZE);                  // Reserve space for the dictionary to prevent rehashing
-        for (uint16_t i = 0; i < INITIAL_DICT_SIZE; ++i)
+        const bool primed = dictionary != nullptr;
+        const uint32_t id = primed ? dictionary->id : 0;
+        if (cached.encoder && cached.codeBits == codeBits && cached.primed == primed && cached.id == id)
+        {
+            cached.encoder->reset(output);
+        }
+        else
         {
-            dict[std::string(1, static_cast<char>(i))] = i; // Initialize dictionary with single-byte sequences
+            cached.encoder = std::make_unique<Encoder>(codeBits, dictionary, output);
+            cached.codeBits = codeBits;
+            cached.primed = primed;
+            cached.id = id;
         }
+        return *cached.encoder;
+    }
 
-        std::vector<uint16_t> compressed; // Vector to store compressed data
-        compressed.reserve(fileSize);     // Reserve space for the worst-case scenario
+    /**
+     * @brief Writes the header byte, then either one code stream or a sequence of independently coded blocks.
+     */
+    void LZW::compressStream(std::istream &input, std::ostream &output) const
+    {
+        if (blockBytes == 0)
+        {
+            writeHeader(output, codeBits, false, trained);
+            encodeCodes(input, output);
+            return;
+        }
 
-        std::string current;                   // Current sequence
-        uint16_t nextCode = INITIAL_DICT_SIZE; // Next available code
+        // Each block starts with a fresh dictionary, so blocks are coded on the workers and written back in
+        // order as (compressed size, codes) records, followed by a zero size
+        writeHeader(output, codeBits, true, trained);
+        parallel::orderedPipeline(
+            threadCount,
+            [&](size_t, std::string &block)
+            {
+                block.resize(blockBytes);
+                input.read(block.data(), static_cast<std::streamsize>(block.size()));
+                block.resize(static_cast<size_t>(input.gcount()));
+                return !block.empty();
+            },
+            [this](size_t, unsigned, std::string &block)
+            {
+                std::ostringstream coded;
+                Encoder &encoder = threadEncoder(codeBits, trained, coded);
+                encoder.feed(reinterpret_cast<const uint8_t *>(block.data()), block.size());
+                encoder.finish();
+                return std::move(coded).str();
+            },
+            [&](size_t, std::string &coded)
+            {
+                writeBlockRecord(output, coded);
+            });
+        writeBlockRecord(output, {});
+    }
 
-        // Process each byte in the input buffer
-        for (uint8_t byte : buffer)
+    /**
+     * @brief Same output as compressStream on the same bytes, coding straight from the buffer.
+     */
+    void LZW::compressBytes(const uint8_t *data, size_t size, std::ostream &output) const
+    {
+        if (blockBytes == 0)
         {
-            std::string next = current + static_cast<char>(byte); // Append the byte to the current sequence
-            auto sequene = dict.find(next);                       // Find the sequence in the dictionary
+            writeHeader(output, codeBits, false, trained);
+            Encoder &encoder = threadEncoder(codeBits, trained, output);
+            encoder.feed(data, size);
+            encoder.finish();
+            return;
+        }
 
-            if (sequene != dict.end())
+        writeHeader(output, codeBits, true, trained);
+        const size_t blockCount = (size + blockBytes - 1) / blockBytes;
+        parallel::orderedMap(
+            blockCount, threadCount,
+            [&](size_t index)
             {
-                current = std::move(next); // Move to the next sequence
-            }
-            else
+                const size_t offset = index * blockBytes;
+                std::ostringstream coded;
+                Encoder &encoder = threadEncoder(codeBits, trained, coded);
+                encoder.feed(data + offset, std::min(blockBytes, size - offset));
+                encoder.finish();
+                return std::move(coded).str();
+            },
+            [&](size_t, std::string &coded)
             {
-                compressed.push_back(dict[current]); // Add the current sequence to the compressed data
-                if (nextCode < DICTIONARY_SIZE)
-                {
-                    dict.emplace(std::move(next), nextCode++); // Add the new sequence to the dictionary
-                }
-                current = std::string(1, static_cast<char>(byte)); // Start a new sequence with the current byte
-            }
+                writeBlockRecord(output, coded);
+            });
+        writeBlockRecord(output, {});
+    }
+
+    /**
+     * @brief Worst case: one code of codeBits bits per input byte, plus the CLEARs the ratio monitor can emit and END.
+     */
+    size_t LZW::maxCompressedSize(size_t size) const
+    {
+        const auto streamBytes = [this](size_t bytes)
+        {
+            const size_t codes = bytes + bytes / RatioMonitor::CHECK_INTERVAL + 2;
+            return (codes * codeBits + 7) / 8;
+        };
+        const size_t header = 1 + (trained != nullptr ? sizeof(trained->id) : 0);
+        if (blockBytes == 0)
+        {
+            return header + streamBytes(size);
         }
+        const size_t blockCount = (size + blockBytes - 1) / blockBytes;
+        return header + blockCount * (sizeof(size_t) + streamBytes(blockBytes)) + sizeof(size_t);
+    }
+
+    /**
+     * @brief Compresses a buffer into a vector that grows with the output.
+     */
+    std::vector<std::byte> LZW::compressBuffer(std::span<const std::byte> input) const
+    {
+        std::vector<std::byte> compressed;
+        io::VectorBuffer buffer(compressed);
+        std::ostream output(&buffer);
+        compressBytes(reinterpret_cast<const uint8_t *>(input.data()), input.size(), output);
+        return compressed;
+    }
 
-        if (!current.empty())
+    /**
+     * @brief Compresses a buffer into caller memory; the stream fails once the output range is full.
+     */
+    size_t LZW::compressBuffer(std::span<const std::byte> input, std::span<std::byte> output) const
+    {
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream stream(&buffer);
+        compressBytes(reinterpret_cast<const uint8_t *>(input.data()), input.size(), stream);
+        if (!stream)
         {
-            compressed.push_back(dict[current]); // Add the last sequence to the compressed data
+            throw std::invalid_argument("Output buffer too small for the compressed data");
         }
+        return buffer.written();
+    }
 
-        // Write compressed data to the output file
-        const size_t compressedSize = compressed.size();
-        output.write(reinterpret_cast<const char *>(&compressedSize), sizeof(compressedSize));
-        output.write(reinterpret_cast<const char *>(compressed.data()), compressed.size() * sizeof(uint16_t));
+    /**
+     * @brief Codes everything readable from input, holding only io::BUFFER_SIZE bytes of input and output.
+     */
+    void LZW::encodeCodes(std::istream &input, std::ostream &output) const
+    {
+        Encoder &encoder = threadEncoder(codeBits, trained, output);
+        std::vector<uint8_t> buffer(io::BUFFER_SIZE);
+        while (input)
+        {
+            input.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            encoder.feed(buffer.data(), static_cast<size_t>(input.gcount()));
+        }
+        encoder.finish();
     }
 
     /**
@@ -106,64 +628,280 @@ namespace lzw
      */
     void LZW::decompress(const std::string &inputFile, const std::string &outputFile)
     {
-        std::ifstream input(inputFile, std::ios::binary);
-        std::ofstream output(outputFile, std::ios::binary);
+        io::InputFile input(inputFile); // Memory mapped when possible
+        io::OutputFile output(outputFile);
 
-        if (!input || !output)
+        try
         {
-            throw std::runtime_error("Error opening files");
+            decompressStream(input.stream(), output.stream());
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(std::string(e.what()) + ": " + inputFile);
         }
+        output.close();
+    }
 
-        initializeDictionary();
+    /**
+     * @brief Decompresses one END-terminated code stream, holding at most io::BUFFER_SIZE bytes plus one
+     * sequence of output.
+     */
+    void LZW::decompressStream(std::istream &input, std::ostream &output)
+    {
+        // Read the dictionary size and the block flag
+        const int header = input.get();
+        if (!input)
+        {
+            throw std::runtime_error("Truncated LZW header");
+        }
+        const int fileCodeBits = header & ~(BLOCKED_FLAG | PRIMED_FLAG);
+        if (fileCodeBits < static_cast<int>(MIN_CODE_BITS) || fileCodeBits > static_cast<int>(MAX_CODE_BITS))
+        {
+            throw std::runtime_error("Invalid LZW dictionary size");
+        }
+        const uint32_t dictionarySize = uint32_t{1} << fileCodeBits;
 
-        // Read compressed data size
-        size_t compressedSize;
-        input.read(reinterpret_cast<char *>(&compressedSize), sizeof(compressedSize));
+        // Images coded with a trained dictionary name it by id; it has to be the one this object holds
+        const TrainedDictionary *primed = nullptr;
+        if ((header & PRIMED_FLAG) != 0)
+        {
+            uint32_t id;
+            if (!input.read(reinterpret_cast<char *>(&id), sizeof(id)))
+            {
+                throw std::runtime_error("Truncated LZW header");
+            }
+            if (trained == nullptr || trained->id != id)
+            {
+                throw std::runtime_error("Compressed data needs trained LZW dictionary " + formatDictionaryId(id));
+            }
+            if (primedCodeCount(trained) > dictionarySize)
+            {
+                throw std::runtime_error("Invalid LZW dictionary size");
+            }
+            primed = trained;
+        }
 
-        std::vector<uint16_t> compressed(compressedSize);
-        input.read(reinterpret_cast<char *>(compressed.data()), compressedSize * sizeof(uint16_t));
+        if ((header & BLOCKED_FLAG) == 0)
+        {
+            decodeCodes(input, output, dictionarySize, primed);
+            return;
+        }
 
-        std::vector<uint8_t> outputBuffer;
-        outputBuffer.reserve(compressedSize * 2);
+        // Read block records on this thread and decode them on the workers, each with its own dictionary
+        LZW blockDecoder = *this;
+        blockDecoder.threadCount = 1;
+        std::vector<LZW> decoders(parallel::resolveThreads(threadCount), blockDecoder);
+        parallel::orderedPipeline(
+            threadCount,
+            [&](size_t, std::string &block)
+            {
+                size_t codedSize;
+                if (!input.read(reinterpret_cast<char *>(&codedSize), sizeof(codedSize)))
+                {
+                    throw std::runtime_error("Truncated LZW block");
+                }
+                if (codedSize == 0)
+                {
+                    return false;
+                }
+                // A block codes at most MAX_BLOCK_SIZE bytes with codes of at most MAX_CODE_BITS bits each
+                if (codedSize > MAX_BLOCK_SIZE / 8 * MAX_CODE_BITS + 2 * sizeof(size_t))
+                {
+                    throw std::runtime_error("Invalid LZW block size");
+                }
+                block.resize(codedSize);
+                if (!input.read(block.data(), static_cast<std::streamsize>(codedSize)))
+                {
+                    throw std::runtime_error("Truncated LZW block");
+                }
+                return true;
+            },
+            [&decoders, dictionarySize, primed](size_t, unsigned id, std::string &block)
+            {
+                std::istringstream blockStream(std::move(block));
+                std::ostringstream decoded;
+                decoders[id].decodeCodes(blockStream, decoded, dictionarySize, primed);
+                return std::move(decoded).str();
+            },
+            [&](size_t, std::string &decoded)
+            {
+                output.write(decoded.data(), static_cast<std::streamsize>(decoded.size()));
+            });
+    }
 
-        uint16_t nextCode = INITIAL_DICT_SIZE;
+    /**
+     * @brief Decompresses a buffer into a vector that grows with the output.
+     */
+    std::vector<std::byte> LZW::decompressBuffer(std::span<const std::byte> input)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream stream(&source);
+        std::vector<std::byte> decompressed;
+        io::VectorBuffer buffer(decompressed);
+        std::ostream output(&buffer);
+        decompressStream(stream, output);
+        return decompressed;
+    }
 
-        // Process first code
-        const auto &firstSeq = dictionary[compressed[0]].sequence;
-        outputBuffer.insert(outputBuffer.end(), firstSeq.begin(), firstSeq.end());
+    /**
+     * @brief Decompresses a buffer into caller memory.
+     */
+    size_t LZW::decompressBuffer(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        io::MemoryBuffer source(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        std::istream stream(&source);
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream decoded(&buffer);
+        decompressStream(stream, decoded);
+        if (!decoded)
+        {
+            throw std::invalid_argument("Output buffer too small for the decompressed data");
+        }
+        return buffer.written();
+    }
+
+    /**
+     * @brief Decodes one END-terminated code stream for a dictionary of dictionarySize codes.
+     */
+    void LZW::decodeCodes(std::istream &input, std::ostream &output, uint32_t dictionarySize, const TrainedDictionary *primed)
+    {
+        initializeDictionary(dictionarySize, primed);
+        const uint32_t firstFree = primedCodeCount(primed);
 
-        std::vector<uint8_t> current = firstSeq;
+        // Both buffers are members, so decoding many small streams with one object allocates them once
+        io::StreamBitReader reader(input, codeBuffer);
+        outputBuffer.clear();
+        outputBuffer.reserve(io::BUFFER_SIZE);
 
-        // Process remaining codes
-        for (size_t i = 1; i < compressedSize; ++i)
+        auto drainOutput = [&]()
         {
-            uint16_t code = compressed[i];
-            std::vector<uint8_t> entry;
+            output.write(reinterpret_cast<const char *>(outputBuffer.data()), static_cast<std::streamsize>(outputBuffer.size()));
+            outputBuffer.clear();
+        };
 
-            if (code < nextCode)
+        // Write the sequence of a code backwards by following its prefix chain
+        auto appendSequence = [&](uint32_t code)
+        {
+            const size_t start = outputBuffer.size();
+            outputBuffer.resize(start + length[code]);
+            uint8_t *out = outputBuffer.data() + outputBuffer.size();
+            while (code >= INITIAL_DICT_SIZE)
             {
-                entry = dictionary[code].sequence;
+                *--out = lastByte[code];
+                code = prefixCode[code];
             }
-            else
+            *--out = static_cast<uint8_t>(code);
+            if (outputBuffer.size() >= io::BUFFER_SIZE)
             {
-                entry = current;
-                entry.push_back(current[0]);
+                drainOutput();
             }
+        };
 
-            outputBuffer.insert(outputBuffer.end(), entry.begin(), entry.end());
+        uint32_t nextCode = firstFree;
+        bool havePrevious = false; // False at the start and right after a CLEAR code
+        uint32_t previous = 0;
 
-            if (nextCode < DICTIONARY_SIZE)
+        while (true)
+        {
+            // The encoder's next code is one ahead of ours whenever this code will define an entry
+            const uint32_t encoderNext = std::min(nextCode + (havePrevious ? 1 : 0), dictionarySize);
+            const uint32_t code = reader.get(codeWidth(encoderNext));
+
+            if (code == END_CODE)
+            {
+                break;
+            }
+            if (code == CLEAR_CODE)
+            {
+                nextCode = firstFree;
+                havePrevious = false;
+                continue;
+            }
+            if (!havePrevious)
             {
-                dictionary[nextCode].sequence = current;
-                dictionary[nextCode].sequence.push_back(entry[0]);
-                dictionary[nextCode].used = true;
+                if (code >= firstFree)
+                {
+                    throw std::runtime_error("Invalid LZW code in compressed data");
+                }
+                appendSequence(code);
+                previous = code;
+                havePrevious = true;
+                continue;
+            }
+            if (code > nextCode || (code == nextCode && nextCode == dictionarySize))
+            {
+                throw std::runtime_error("Invalid LZW code in compressed data");
+            }
+
+            // New entry: previous sequence plus the first byte of this one (its own first byte when it is the entry being defined)
+            if (nextCode < dictionarySize)
+            {
+                const uint8_t first = code < nextCode ? firstByte[code] : firstByte[previous];
+                prefixCode[nextCode] = previous;
+                lastByte[nextCode] = first;
+                firstByte[nextCode] = firstByte[previous];
+                length[nextCode] = length[previous] + 1;
                 ++nextCode;
             }
 
-            current = std::move(entry);
+            appendSequence(code);
+            previous = code;
         }
 
-        output.write(reinterpret_cast<const char *>(outputBuffer.data()), outputBuffer.size());
+        // Leave the input at the end of the codes, so another image can follow this one
+        reader.returnUnread();
+        drainOutput();
+    }
+
+    CompressContext::CompressContext(unsigned maxCodeBits, const TrainedDictionary *dictionary) : codeBits(maxCodeBits), trained(dictionary)
+    {
+        if (maxCodeBits < LZW::MIN_CODE_BITS || maxCodeBits > LZW::MAX_CODE_BITS)
+        {
+            throw std::invalid_argument("LZW dictionary size must be between " + std::to_string(LZW::MIN_CODE_BITS) + " and " +
+                                        std::to_string(LZW::MAX_CODE_BITS) + " bits");
+        }
+        checkDictionaryFits(dictionary, maxCodeBits);
+    }
+
+    CompressContext::~CompressContext() = default;
+
+    /**
+     * @brief Writes the header byte and one code stream, reusing the encoder of the previous call.
+     */
+    void CompressContext::compressTo(std::span<const std::byte> input, std::ostream &output)
+    {
+        LZW::writeHeader(output, codeBits, false, trained);
+        if (encoder)
+        {
+            encoder->reset(output);
+        }
+        else
+        {
+            encoder = std::make_unique<LZW::Encoder>(codeBits, trained, output);
+        }
+        encoder->feed(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        encoder->finish();
+    }
+
+    std::vector<std::byte> CompressContext::compress(std::span<const std::byte> input)
+    {
+        std::vector<std::byte> compressed;
+        io::VectorBuffer buffer(compressed);
+        std::ostream output(&buffer);
+        compressTo(input, output);
+        return compressed;
+    }
+
+    size_t CompressContext::compress(std::span<const std::byte> input, std::span<std::byte> output)
+    {
+        io::SpanBuffer buffer(reinterpret_cast<uint8_t *>(output.data()), output.size());
+        std::ostream stream(&buffer);
+        compressTo(input, stream);
+        if (!stream)
+        {
+            throw std::invalid_argument("Output buffer too small for the compressed data");
+        }
+        return buffer.written();
     }
 
     /**
@@ -178,11 +916,6 @@ namespace lzw
      */
     void LZW::compressFolder(const std::string &inputFolder, const std::string &outputFile)
     {
-        if (!fs::exists(inputFolder))
-        {
-            throw std::runtime_error("Input folder does not exist: " + inputFolder);
-        }
-
         // Append .folder extension if not already present
         std::string finalOutputFile = outputFile;
         if (fs::path(finalOutputFile).extension() != ".folder.lzw")
@@ -190,82 +923,10 @@ namespace lzw
             finalOutputFile += ".folder.lzw";
         }
 
-        std::ofstream outFile(finalOutputFile, std::ios::binary);
-        if (!outFile)
-        {
-            throw std::runtime_error("Failed to open output file: " + finalOutputFile);
-        }
-
-        // Collect all files including those in subfolders
-        std::vector<fs::path> files;
-        for (const auto &entry : fs::recursive_directory_iterator(inputFolder))
-        {
-            if (entry.is_regular_file())
-            {
-                files.push_back(entry.path());
-            }
-        }
-
-        // Write file count
-        const size_t fileCount = files.size();
-        outFile.write(reinterpret_cast<const char *>(&fileCount), sizeof(fileCount));
-
-        const std::string fileExtension = fs::path(finalOutputFile).extension().empty() ? ".lzw" : fs::path(finalOutputFile).extension().string();
-        constexpr size_t BUFFER_SIZE = 8192; // 8KB buffer
-        std::vector<char> readBuffer(BUFFER_SIZE);
-
-        // Get base path for relative path calculation
-        const fs::path basePath = fs::canonical(inputFolder);
-
-        for (const auto &filePath : files)
-        {
-            const std::string tempCompressedFile = fs::temp_directory_path() / (std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + fileExtension);
-
-            try
-            {
-                // Calculate relative path from input folder
-                fs::path relativePath = fs::canonical(filePath).lexically_relative(basePath);
-                const std::string relativePathStr = relativePath.string();
-
-                // Compress the file
-                compress(filePath.string(), tempCompressedFile);
-
-                // Read compressed file efficiently
-                std::ifstream tempFile(tempCompressedFile, std::ios::binary | std::ios::ate);
-                if (!tempFile)
-                {
-                    throw std::runtime_error("Failed to open temp compressed file: " + tempCompressedFile);
-                }
-
-                const size_t dataSize = tempFile.tellg();
-                tempFile.seekg(0);
-
-                // Write relative path length and path
-                const size_t pathLength = relativePathStr.size();
-                outFile.write(reinterpret_cast<const char *>(&pathLength), sizeof(pathLength));
-                outFile.write(relativePathStr.c_str(), pathLength);
-
-                // Write data size and content
-                outFile.write(reinterpret_cast<const char *>(&dataSize), sizeof(dataSize));
-
-                while (tempFile)
-                {
-                    tempFile.read(readBuffer.data(), BUFFER_SIZE);
-                    outFile.write(readBuffer.data(), tempFile.gcount());
-                }
-
-                tempFile.close();
-                fs::remove(tempCompressedFile);
-            }
-            catch (const std::exception &e)
-            {
-                if (fs::exists(tempCompressedFile))
-                {
-                    fs::remove(tempCompressedFile);
-                }
-                throw std::runtime_error("Error processing file " + filePath.string() + ": " + e.what());
-            }
-        }
+        // Files are already spread over the workers, so each one is coded on a single thread
+        const LZW fileCompressor(codeBits, 1, blockBytes, trained);
+        archive::create(inputFolder, finalOutputFile, archive::Codec::Lzw, threadCount, [&fileCompressor](const std::string &inputFile, std::ostream &output)
+                        { fileCompressor.compressFile(inputFile, output); });
     }
 
     /**
@@ -280,92 +941,193 @@ namespace lzw
      */
     void LZW::decompressFolder(const std::string &inputFile, const std::string &outputFolder)
     {
-        if (!fs::exists(inputFile))
-        {
-            throw std::runtime_error("Input file does not exist: " + inputFile);
-        }
+        // Each worker decodes with its own dictionary, one file at a time
+        LZW fileDecoder = *this;
+        fileDecoder.threadCount = 1;
+        std::vector<LZW> decoders(parallel::resolveThreads(threadCount), fileDecoder);
+        archive::extract(inputFile, outputFolder, archive::Codec::Lzw, threadCount, [&decoders](std::istream &input, std::ostream &output, unsigned worker)
+                         { decoders[worker].decompressStream(input, output); });
+    }
 
-        std::ifstream inFile(inputFile, std::ios::binary);
-        if (!inFile)
+    /**
+     * @brief Parses every sample like the encoder while counting how often each phrase is matched, then keeps the
+     * most matched phrases.
+     *
+     * A phrase is only matched right after its prefix, so sorting by match count (shorter phrases first on ties)
+     * puts every prefix before its extensions and the kept phrases can be numbered in that order.
+     */
+    TrainedDictionary trainDictionary(const std::string &samplePath, unsigned codeBits)
+    {
+        if (codeBits < LZW::MIN_CODE_BITS || codeBits > LZW::MAX_CODE_BITS)
         {
-            throw std::runtime_error("Failed to open compressed file: " + inputFile);
+            throw std::invalid_argument("LZW dictionary size must be between " + std::to_string(LZW::MIN_CODE_BITS) + " and " +
+                                        std::to_string(LZW::MAX_CODE_BITS) + " bits");
         }
+        // Half of the codes stay free for phrases of the data being coded
+        const size_t capacity = ((size_t{1} << codeBits) - LZW::FIRST_CODE) / 2;
+        const size_t maxCandidates = 4 * capacity;
 
-        // Remove output folder if it exists and create it fresh
-        if (fs::exists(outputFolder))
+        std::vector<std::string> samples;
+        if (fs::is_directory(samplePath))
         {
-            fs::remove_all(outputFolder);
+            for (const auto &entry : fs::recursive_directory_iterator(samplePath))
+            {
+                if (entry.is_regular_file())
+                {
+                    samples.push_back(entry.path().string());
+                }
+            }
+            std::sort(samples.begin(), samples.end());
         }
-
-        // Create fresh output directory
-        if (!fs::create_directory(outputFolder))
+        else
         {
-            throw std::runtime_error("Failed to create output directory: " + outputFolder);
+            samples.push_back(samplePath);
         }
 
-        const std::string fileExtension = fs::path(inputFile).extension().empty() ? ".lzw" : fs::path(inputFile).extension().string();
-
-        size_t fileCount;
-        inFile.read(reinterpret_cast<char *>(&fileCount), sizeof(fileCount));
-
-        constexpr size_t BUFFER_SIZE = 8192; // 8KB buffer
-        std::vector<char> buffer(BUFFER_SIZE);
-
-        for (size_t i = 0; i < fileCount; ++i)
+        // Candidate phrases: node n >= 256 is node parent followed by byte, nodes below 256 are the single bytes
+        struct Node
         {
-            // Read relative path
-            size_t pathLength;
-            inFile.read(reinterpret_cast<char *>(&pathLength), sizeof(pathLength));
-            std::string relativePath(pathLength, '\0');
-            inFile.read(&relativePath[0], pathLength);
+            uint32_t parent = 0;
+            uint8_t byte = 0;
+            uint32_t depth = 1;
+            uint64_t matches = 0;
+        };
+        std::vector<Node> nodes(256);
+        std::unordered_map<uint64_t, uint32_t> children; // parent << 8 | byte -> node
 
-            // Read file size
-            size_t dataSize;
-            inFile.read(reinterpret_cast<char *>(&dataSize), sizeof(dataSize));
-
-            // Create temporary file
-            const std::string tempCompressedFile = fs::temp_directory_path() / (std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + fileExtension);
-
-            try
+        const auto parse = [&](const uint8_t *data, size_t size)
+        {
+            if (size == 0)
             {
-                // Construct full output path
-                fs::path fullOutputPath = fs::path(outputFolder) / relativePath;
-
-                // Create parent directories if they don't exist
-                fs::create_directories(fullOutputPath.parent_path());
-
-                // Write compressed data to temporary file
-                std::ofstream tempFile(tempCompressedFile, std::ios::binary);
-                if (!tempFile)
+                return;
+            }
+            uint32_t current = data[0];
+            for (size_t i = 1; i < size; ++i)
+            {
+                const uint64_t key = (uint64_t{current} << 8) | data[i];
+                const auto child = children.find(key);
+                if (child != children.end())
                 {
-                    throw std::runtime_error("Failed to create temporary file: " + tempCompressedFile);
+                    current = child->second;
+                    ++nodes[current].matches;
+                    continue;
                 }
-
-                // Copy data in chunks
-                size_t remainingBytes = dataSize;
-                while (remainingBytes > 0)
+                if (nodes.size() < 256 + maxCandidates)
                 {
-                    const size_t bytesToRead = std::min(BUFFER_SIZE, remainingBytes);
-                    inFile.read(buffer.data(), bytesToRead);
-                    tempFile.write(buffer.data(), bytesToRead);
-                    remainingBytes -= bytesToRead;
+                    children.emplace(key, static_cast<uint32_t>(nodes.size()));
+                    nodes.push_back(Node{current, data[i], nodes[current].depth + 1, 0});
                 }
-                tempFile.close();
+                current = data[i];
+            }
+        };
 
-                // Decompress to final destination
-                decompress(tempCompressedFile, fullOutputPath.string());
+        for (const std::string &sample : samples)
+        {
+            const io::MappedFile input(sample);
+            if (input.mapped())
+            {
+                parse(input.data(), input.size());
+                continue;
+            }
 
-                // Cleanup
-                fs::remove(tempCompressedFile);
+            std::ifstream inFile(sample, std::ios::binary);
+            if (!inFile)
+            {
+                throw std::runtime_error("Error opening files");
             }
-            catch (const std::exception &e)
+            const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+            parse(bytes.data(), bytes.size());
+        }
+
+        std::vector<uint32_t> ranked;
+        for (uint32_t node = 256; node < nodes.size(); ++node)
+        {
+            if (nodes[node].matches > 0)
             {
-                if (fs::exists(tempCompressedFile))
-                {
-                    fs::remove(tempCompressedFile);
-                }
-                throw std::runtime_error("Error processing file " + relativePath + ": " + e.what());
+                ranked.push_back(node);
             }
         }
+        std::sort(ranked.begin(), ranked.end(), [&nodes](uint32_t a, uint32_t b)
+                  {
+                      if (nodes[a].matches != nodes[b].matches)
+                      {
+                          return nodes[a].matches > nodes[b].matches;
+                      }
+                      if (nodes[a].depth != nodes[b].depth)
+                      {
+                          return nodes[a].depth < nodes[b].depth;
+                      }
+                      return a < b; });
+        ranked.resize(std::min(ranked.size(), capacity));
+
+        // Number the kept phrases in rank order; every prefix is numbered before its extensions
+        std::unordered_map<uint32_t, uint32_t> codes;
+        TrainedDictionary dictionary;
+        for (uint32_t node : ranked)
+        {
+            const uint32_t parent = nodes[node].parent;
+            codes.emplace(node, LZW::FIRST_CODE + static_cast<uint32_t>(dictionary.prefixes.size()));
+            dictionary.prefixes.push_back(parent < 256 ? parent : codes.at(parent));
+            dictionary.bytes.push_back(nodes[node].byte);
+        }
+        dictionary.id = dictionaryId(dictionary);
+        return dictionary;
+    }
+
+    void saveDictionary(const TrainedDictionary &dictionary, const std::string &path)
+    {
+        io::OutputFile output(path);
+        std::ostream &out = output.stream();
+        const uint32_t count = static_cast<uint32_t>(dictionary.prefixes.size());
+        out.write(DICTIONARY_MAGIC.data(), DICTIONARY_MAGIC.size());
+        out.write(reinterpret_cast<const char *>(&dictionary.id), sizeof(dictionary.id));
+        out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char *>(dictionary.prefixes.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        out.write(reinterpret_cast<const char *>(dictionary.bytes.data()), static_cast<std::streamsize>(count));
+        output.close();
+    }
+
+    /**
+     * @brief Reads a trained dictionary, checking that every entry extends a byte or an earlier entry and that the
+     * id matches the entries, so a damaged file is rejected here rather than decoding garbage.
+     */
+    TrainedDictionary loadDictionary(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error("Failed to open dictionary file: " + path);
+        }
+
+        std::array<char, DICTIONARY_MAGIC.size()> magic{};
+        TrainedDictionary dictionary;
+        uint32_t count = 0;
+        if (!in.read(magic.data(), magic.size()) || magic != DICTIONARY_MAGIC ||
+            !in.read(reinterpret_cast<char *>(&dictionary.id), sizeof(dictionary.id)) ||
+            !in.read(reinterpret_cast<char *>(&count), sizeof(count)) ||
+            count > (uint32_t{1} << LZW::MAX_CODE_BITS) - LZW::FIRST_CODE)
+        {
+            throw std::runtime_error("Invalid LZW dictionary file: " + path);
+        }
+        dictionary.prefixes.resize(count);
+        dictionary.bytes.resize(count);
+        if (!in.read(reinterpret_cast<char *>(dictionary.prefixes.data()), static_cast<std::streamsize>(count * sizeof(uint32_t))) ||
+            !in.read(reinterpret_cast<char *>(dictionary.bytes.data()), static_cast<std::streamsize>(count)))
+        {
+            throw std::runtime_error("Invalid LZW dictionary file: " + path);
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t prefix = dictionary.prefixes[i];
+            if (prefix >= LZW::FIRST_CODE + i || (prefix >= 256 && prefix < LZW::FIRST_CODE))
+            {
+                throw std::runtime_error("Invalid LZW dictionary file: " + path);
+            }
+        }
+        if (dictionary.id != dictionaryId(dictionary))
+        {
+            throw std::runtime_error("Invalid LZW dictionary file: " + path);
+        }
+        return dictionary;
     }
 }
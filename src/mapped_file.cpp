@@ -0,0 +1,137 @@
+#include "mapped_file.hpp"
+#include "bit_io.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io
+{
+    MappedFile::MappedFile(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open input file: " + path);
+        }
+
+        struct stat status{};
+        if (::fstat(fd, &status) == 0 && S_ISREG(status.st_mode))
+        {
+            length = static_cast<size_t>(status.st_size);
+            if (length == 0)
+            {
+                // Nothing to map; an empty range is still a valid view of the file
+                isMapped = true;
+            }
+            else
+            {
+                void *address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (address != MAP_FAILED)
+                {
+                    ::madvise(address, length, MADV_SEQUENTIAL);
+                    bytes = static_cast<const uint8_t *>(address);
+                    isMapped = true;
+                }
+                else
+                {
+                    length = 0;
+                }
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (bytes != nullptr)
+        {
+            ::munmap(const_cast<uint8_t *>(bytes), length);
+        }
+    }
+
+    MemoryBuffer::MemoryBuffer(const uint8_t *data, size_t size)
+    {
+        // The get area is never written through, so the const_cast is only to satisfy std::streambuf
+        char *begin = reinterpret_cast<char *>(const_cast<uint8_t *>(data));
+        setg(begin, begin, begin + size);
+    }
+
+    MemoryBuffer::pos_type MemoryBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which)
+    {
+        const off_type base = direction == std::ios_base::beg ? 0 : direction == std::ios_base::cur ? gptr() - eback() : egptr() - eback();
+        const off_type target = base + offset;
+        if ((which & std::ios_base::in) == 0 || target < 0 || target > egptr() - eback())
+        {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + target, egptr());
+        return pos_type(target);
+    }
+
+    MemoryBuffer::pos_type MemoryBuffer::seekpos(pos_type position, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+
+    SpanBuffer::SpanBuffer(uint8_t *data, size_t size)
+    {
+        char *begin = reinterpret_cast<char *>(data);
+        setp(begin, begin + size);
+    }
+
+    std::streamsize VectorBuffer::xsputn(const char *data, std::streamsize count)
+    {
+        const auto *begin = reinterpret_cast<const std::byte *>(data);
+        bytes.insert(bytes.end(), begin, begin + count);
+        return count;
+    }
+
+    VectorBuffer::int_type VectorBuffer::overflow(int_type c)
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            return traits_type::not_eof(c);
+        }
+        bytes.push_back(static_cast<std::byte>(traits_type::to_char_type(c)));
+        return c;
+    }
+
+    InputFile::InputFile(const std::string &path) : mapping(path), memory(mapping.data(), mapping.size()), in(nullptr)
+    {
+        if (mapping.mapped())
+        {
+            in.rdbuf(&memory);
+            return;
+        }
+        // The buffer has to be installed before the file is opened to take effect
+        fallbackBuffer.resize(BUFFER_SIZE);
+        fallback.pubsetbuf(fallbackBuffer.data(), static_cast<std::streamsize>(fallbackBuffer.size()));
+        if (fallback.open(path, std::ios::in | std::ios::binary) == nullptr)
+        {
+            throw std::runtime_error("Failed to open input file: " + path);
+        }
+        in.rdbuf(&fallback);
+    }
+
+    OutputFile::OutputFile(const std::string &path) : name(path), buffer(BUFFER_SIZE), out(nullptr)
+    {
+        file.pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (file.open(path, std::ios::out | std::ios::trunc | std::ios::binary) == nullptr)
+        {
+            throw std::runtime_error("Failed to open output file: " + path);
+        }
+        out.rdbuf(&file);
+    }
+
+    void OutputFile::close()
+    {
+        const bool written = static_cast<bool>(out.flush());
+        if (file.close() == nullptr || !written)
+        {
+            throw std::runtime_error("Failed to write output file: " + name);
+        }
+    }
+}
@@ -0,0 +1,267 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel
+{
+    unsigned resolveThreads(unsigned requested)
+    {
+        if (requested == 0)
+        {
+            requested = std::thread::hardware_concurrency();
+        }
+        return std::max(requested, 1u);
+    }
+
+    void orderedPipeline(unsigned threads, const std::function<bool(size_t, std::string &)> &read,
+                         const std::function<std::string(size_t, unsigned, std::string &)> &transform,
+                         const std::function<void(size_t, std::string &)> &write)
+    {
+        const unsigned workerCount = resolveThreads(threads);
+        if (workerCount == 1)
+        {
+            std::string input;
+            for (size_t i = 0; read(i, input); ++i)
+            {
+                std::string output = transform(i, 0, input);
+                write(i, output);
+            }
+            return;
+        }
+
+        // Results travel through a ring of slots; index i uses slot i % window
+        struct Slot
+        {
+            std::string result;
+            std::exception_ptr error;
+            bool ready = false;
+        };
+        const size_t window = 2 * size_t{workerCount};
+        std::vector<Slot> slots(window);
+
+        std::mutex readMutex;             // Held while claiming and reading an item, so reads happen in index order
+        std::mutex mutex;                 // Guards everything below
+        std::condition_variable produced; // A slot became ready or the input ended
+        std::condition_variable consumed; // The consumer advanced or the pool is stopping
+        size_t nextIndex = 0;             // Next index to read
+        size_t total = SIZE_MAX;          // Number of items, known once read() returns false
+        size_t written = 0;               // Number of results consumed
+        bool stop = false;
+
+        auto publish = [&](size_t index, Slot slot)
+        {
+            slot.ready = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[index % window] = std::move(slot);
+            }
+            produced.notify_all();
+        };
+
+        auto worker = [&](unsigned id)
+        {
+            std::string input;
+            while (true)
+            {
+                size_t index;
+                {
+                    std::unique_lock<std::mutex> readLock(readMutex);
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        consumed.wait(lock, [&]
+                                      { return stop || nextIndex >= total || nextIndex < written + window; });
+                        if (stop || nextIndex >= total)
+                        {
+                            return;
+                        }
+                        index = nextIndex++;
+                    }
+
+                    bool more = false;
+                    try
+                    {
+                        more = read(index, input);
+                    }
+                    catch (...)
+                    {
+                        // Report the error at this index and end the input there
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            total = index + 1;
+                        }
+                        consumed.notify_all();
+                        publish(index, Slot{{}, std::current_exception(), false});
+                        return;
+                    }
+                    if (!more)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            total = index;
+                        }
+                        consumed.notify_all();
+                        produced.notify_all();
+                        return;
+                    }
+                }
+
+                Slot slot;
+                try
+                {
+                    slot.result = transform(index, id, input);
+                }
+                catch (...)
+                {
+                    slot.error = std::current_exception();
+                }
+                publish(index, std::move(slot));
+            }
+        };
+
+        std::vector<std::thread> workers;
+        std::exception_ptr failure;
+        try
+        {
+            workers.reserve(workerCount);
+            for (unsigned i = 0; i < workerCount; ++i)
+            {
+                workers.emplace_back(worker, i);
+            }
+
+            // Consume the results in order as they become ready
+            while (true)
+            {
+                Slot slot;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    Slot &next = slots[written % window];
+                    produced.wait(lock, [&]
+                                  { return written >= total || next.ready; });
+                    if (!next.ready)
+                    {
+                        break;
+                    }
+                    slot = std::move(next);
+                    next = Slot{};
+                }
+                if (slot.error)
+                {
+                    std::rethrow_exception(slot.error);
+                }
+                write(written, slot.result);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++written;
+                }
+                consumed.notify_all();
+            }
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        consumed.notify_all();
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    void orderedMap(size_t count, unsigned threads, const std::function<std::string(size_t)> &produce,
+                    const std::function<void(size_t, std::string &)> &consume)
+    {
+        orderedPipeline(
+            count <= 1 ? 1 : static_cast<unsigned>(std::min<size_t>(resolveThreads(threads), count)),
+            [count](size_t index, std::string &)
+            { return index < count; },
+            [&produce](size_t index, unsigned, std::string &)
+            { return produce(index); },
+            consume);
+    }
+
+    void forEach(size_t count, unsigned threads, const std::function<void(size_t, unsigned)> &task)
+    {
+        const size_t workerCount = std::min<size_t>(resolveThreads(threads), count);
+        if (workerCount <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                task(i, 0);
+            }
+            return;
+        }
+
+        std::atomic<size_t> nextIndex{0};
+        std::atomic<bool> stop{false};
+        std::mutex mutex;
+        std::exception_ptr failure; // First exception, guarded by mutex
+
+        auto fail = [&](std::exception_ptr error)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure)
+            {
+                failure = error;
+            }
+            stop = true;
+        };
+
+        auto worker = [&](unsigned id)
+        {
+            while (!stop)
+            {
+                const size_t index = nextIndex.fetch_add(1);
+                if (index >= count)
+                {
+                    return;
+                }
+                try
+                {
+                    task(index, id);
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        try
+        {
+            workers.reserve(workerCount);
+            for (size_t i = 0; i < workerCount; ++i)
+            {
+                workers.emplace_back(worker, static_cast<unsigned>(i));
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+}